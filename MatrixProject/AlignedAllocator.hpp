@@ -0,0 +1,272 @@
+#pragma once
+#ifndef ALIGNED_ALLOCATOR_HPP
+#define ALIGNED_ALLOCATOR_HPP
+
+#include<atomic>
+#include<cstddef>
+#include<new>
+#include<mutex>
+#include<limits>
+#include<algorithm>
+#include<type_traits>
+
+#if defined(__linux__)
+#include<sys/mman.h>
+#endif
+
+namespace my
+{
+	constexpr std::size_t cache_line_size = 64;
+	constexpr std::size_t small_page_size = 4096;
+	constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+	namespace detail
+	{
+		constexpr std::size_t round_up(std::size_t n, std::size_t to) { return (n + to - 1) / to * to; }
+
+		// Rounds a row buffer up to whole cache lines. When the padded size is a multiple of
+		// the 4K page, rows would start at the same offset inside a page and their loads
+		// would alias in the L1 (4K aliasing), so one extra line is added to skew them.
+		constexpr std::size_t padded_row_bytes(std::size_t bytes, std::size_t alignment)
+		{
+			std::size_t padded = round_up(bytes, alignment);
+			if (padded >= small_page_size && padded % small_page_size == 0)
+				padded += alignment;
+			return padded;
+		}
+
+		inline void* aligned_new(std::size_t bytes, std::size_t alignment)
+		{
+			return ::operator new(bytes, std::align_val_t(alignment));
+		}
+		inline void aligned_delete(void* p, std::size_t alignment)
+		{
+			::operator delete(p, std::align_val_t(alignment));
+		}
+
+#if defined(__linux__)
+		// Maps 'bytes' (already rounded to huge_page_size) at a 2 MB boundary.
+		// Explicit huge pages (MAP_HUGETLB) are tried first; they are only available when
+		// the administrator reserved them (vm.nr_hugepages), so on failure an ordinary
+		// mapping is used and transparent huge pages are requested with madvise.
+		inline void* map_huge(std::size_t bytes)
+		{
+#if defined(MAP_HUGETLB)
+			void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p != MAP_FAILED) return p;
+#endif
+			// over-map by one huge page and trim both ends to get 2 MB alignment
+			const std::size_t mapped = bytes + huge_page_size;
+			void* raw = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (raw == MAP_FAILED) throw std::bad_alloc{};
+
+			char* first = static_cast<char*>(raw);
+			char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<std::size_t>(first), huge_page_size));
+			if (aligned != first)
+				::munmap(first, aligned - first);
+
+			char* tail = aligned + bytes;
+			char* last = first + mapped;
+			if (tail != last)
+				::munmap(tail, last - tail);
+
+#if defined(MADV_HUGEPAGE)
+			::madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+			return aligned;
+		}
+		inline void unmap_huge(void* p, std::size_t bytes) { ::munmap(p, bytes); }
+
+		// Buffers up to this size are carved out of shared huge pages instead of getting a
+		// mapping of their own, so at most half of a chunk is lost when one does not fit.
+		constexpr std::size_t huge_arena_block_limit = huge_page_size / 2;
+
+		// Bump allocator over 2 MB chunks from map_huge, shared by every huge_page_allocator.
+		// Rows of one matrix are laid out back to back with padded_row_bytes, which keeps the
+		// 4K skew between them. A chunk only counts its live blocks: freed space is not reused
+		// until the whole chunk is empty, then a retired chunk is unmapped and the current one
+		// is rewound.
+		class huge_page_arena
+		{
+		public:
+			void* allocate(std::size_t bytes, std::size_t alignment)
+			{
+				bytes = std::max(bytes, alignment); // empty rows still need an address inside the chunk
+				std::lock_guard<std::mutex> lock{ mtx };
+				std::size_t pos = current ? round_up(used, alignment) : 0;
+				if (current == nullptr || pos + bytes > huge_page_size)
+				{
+					current = static_cast<char*>(map_huge(huge_page_size));
+					new (current) chunk_header{};
+					used = chunk_header_bytes;
+					pos = round_up(used, alignment);
+				}
+				used = pos + bytes;
+				++header(current)->live;
+				return current + pos;
+			}
+			void deallocate(void* p) noexcept
+			{
+				char* chunk = reinterpret_cast<char*>(reinterpret_cast<std::size_t>(p) / huge_page_size * huge_page_size);
+				std::lock_guard<std::mutex> lock{ mtx };
+				if (--header(chunk)->live != 0)
+					return;
+				if (chunk == current)
+					used = chunk_header_bytes;
+				else
+					unmap_huge(chunk, huge_page_size);
+			}
+
+		private:
+			struct chunk_header { std::size_t live = 0; };
+			static constexpr std::size_t chunk_header_bytes = cache_line_size;
+			static chunk_header* header(char* chunk) { return reinterpret_cast<chunk_header*>(chunk); }
+
+			std::mutex mtx;
+			char* current = nullptr;
+			std::size_t used = 0;
+		};
+
+		// Never destroyed: rows of static matrices may be freed after other statics are gone.
+		inline huge_page_arena& shared_huge_page_arena()
+		{
+			static huge_page_arena* arena = new huge_page_arena;
+			return *arena;
+		}
+
+		// Offset of the next row inside its own huge mapping. Such mappings all start at a
+		// 2 MB boundary, so the rows are moved by whole lines within the page to keep them
+		// from aliasing in the L1; 'slack' is the unused tail of the mapping.
+		inline std::size_t huge_row_skew(std::size_t slack, std::size_t alignment)
+		{
+			static std::atomic<std::size_t> next{ 0 };
+			const std::size_t offset = next.fetch_add(1, std::memory_order_relaxed) % (small_page_size / alignment) * alignment;
+			return std::min(offset, slack / alignment * alignment);
+		}
+#endif
+	}
+
+	// Allocator returning buffers aligned to 'Alignment' bytes (one cache line by default)
+	// and padded as described in detail::padded_row_bytes. Used as the A parameter of
+	// matrix<T, A>, every row of the matrix starts on its own cache line.
+	template<class T, std::size_t Alignment = cache_line_size>
+	class aligned_allocator
+	{
+		static_assert(Alignment >= alignof(T), "alignment must not be weaker than the alignment of T");
+		static_assert((Alignment & (Alignment - 1)) == 0, "alignment must be a power of two");
+
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_move_assignment = std::true_type;
+		using is_always_equal = std::true_type;
+
+		template<class U>
+		struct rebind { using other = aligned_allocator<U, Alignment>; };
+
+		static constexpr std::size_t alignment = Alignment;
+
+		aligned_allocator() noexcept = default;
+		template<class U>
+		aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept {}
+
+		T* allocate(size_type n)
+		{
+			if (n > std::numeric_limits<size_type>::max() / sizeof(T))
+				throw std::bad_array_new_length{};
+
+			return static_cast<T*>(detail::aligned_new(detail::padded_row_bytes(n * sizeof(T), Alignment), Alignment));
+		}
+		void deallocate(T* p, size_type) noexcept
+		{
+			detail::aligned_delete(p, Alignment);
+		}
+
+		template<class U>
+		bool operator==(const aligned_allocator<U, Alignment>&) const noexcept { return true; }
+		template<class U>
+		bool operator!=(const aligned_allocator<U, Alignment>&) const noexcept { return false; }
+	};
+
+	// Aligned allocator which serves buffers from huge pages, which removes most dTLB misses
+	// when walking a big matrix. Since matrix allocates every row separately, buffers smaller
+	// than 'Threshold' (and at most detail::huge_arena_block_limit) are packed into huge pages
+	// shared with other rows (see detail::huge_page_arena); bigger ones get a mapping of their
+	// own from detail::map_huge, rounded to whole huge pages.
+	// On systems other than Linux it is equivalent to aligned_allocator.
+	template<class T, std::size_t Threshold = huge_page_size / 2, std::size_t Alignment = cache_line_size>
+	class huge_page_allocator
+	{
+		static_assert(Alignment >= alignof(T), "alignment must not be weaker than the alignment of T");
+		static_assert((Alignment & (Alignment - 1)) == 0, "alignment must be a power of two");
+		static_assert(Alignment <= small_page_size, "alignment must not exceed the page size");
+
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_move_assignment = std::true_type;
+		using is_always_equal = std::true_type;
+
+		template<class U>
+		struct rebind { using other = huge_page_allocator<U, Threshold, Alignment>; };
+
+		static constexpr std::size_t alignment = Alignment;
+		static constexpr std::size_t threshold = Threshold;
+
+		huge_page_allocator() noexcept = default;
+		template<class U>
+		huge_page_allocator(const huge_page_allocator<U, Threshold, Alignment>&) noexcept {}
+
+		T* allocate(size_type n)
+		{
+			if (n > std::numeric_limits<size_type>::max() / sizeof(T))
+				throw std::bad_array_new_length{};
+
+#if defined(__linux__)
+			if (own_mapping(n))
+			{
+				// the skew goes into the slack of the mapping, it never adds a huge page
+				const std::size_t bytes = detail::round_up(n * sizeof(T), Alignment);
+				const std::size_t mapped = detail::round_up(bytes, huge_page_size);
+				char* base = static_cast<char*>(detail::map_huge(mapped));
+				return reinterpret_cast<T*>(base + detail::huge_row_skew(mapped - bytes, Alignment));
+			}
+			return static_cast<T*>(detail::shared_huge_page_arena().allocate(detail::padded_row_bytes(n * sizeof(T), Alignment), Alignment));
+#else
+			return static_cast<T*>(detail::aligned_new(detail::padded_row_bytes(n * sizeof(T), Alignment), Alignment));
+#endif
+		}
+		void deallocate(T* p, size_type n) noexcept
+		{
+#if defined(__linux__)
+			if (own_mapping(n))
+			{
+				// the skew is below one small page, so the mapping starts at the huge page of p
+				const std::size_t base = reinterpret_cast<std::size_t>(p) / huge_page_size * huge_page_size;
+				detail::unmap_huge(reinterpret_cast<void*>(base), detail::round_up(detail::round_up(n * sizeof(T), Alignment), huge_page_size));
+				return;
+			}
+			detail::shared_huge_page_arena().deallocate(p);
+#else
+			(void)n;
+			detail::aligned_delete(p, Alignment);
+#endif
+		}
+
+		template<class U>
+		bool operator==(const huge_page_allocator<U, Threshold, Alignment>&) const noexcept { return true; }
+		template<class U>
+		bool operator!=(const huge_page_allocator<U, Threshold, Alignment>&) const noexcept { return false; }
+
+	private:
+		static bool own_mapping(size_type n)
+		{
+			const std::size_t bytes = detail::padded_row_bytes(n * sizeof(T), Alignment);
+			return bytes >= Threshold || bytes > detail::huge_arena_block_limit;
+		}
+	};
+}
+
+#endif // ALIGNED_ALLOCATOR_HPP
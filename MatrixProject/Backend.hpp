@@ -0,0 +1,486 @@
+#pragma once
+#ifndef BACKEND_HPP
+#define BACKEND_HPP
+
+#include<atomic>
+#include<vector>
+#include<climits>
+#include<cstdint>
+#include<cstdlib>
+#include<cstring>
+#include<stdexcept>
+#include<algorithm>
+#include<type_traits>
+
+#if defined(MY_MATRIX_USE_CBLAS) && __has_include(<cblas.h>)
+#include<cblas.h>
+#define MY_MATRIX_HAS_CBLAS 1
+#endif
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Gemm.hpp"
+
+namespace my
+{
+	enum class triangle { lower, upper };
+
+	// builtin: the kernels of this library (blocked GEMM, lane-split GEMV, ...);
+	// blas:    a system CBLAS (OpenBLAS, MKL, ...), available when the library is built
+	//          with MY_MATRIX_USE_CBLAS defined and linked against it.
+	enum class backend_kind { builtin, blas };
+
+	// Dense kernels on row-major data with leading dimensions, for float and double.
+	// The routed matrix functions (gemm, solve_triangular) pack their operands and call
+	// the active backend when the element type is float or double and the work (m*n*k
+	// for gemm, n*n*nrhs for solve_triangular) reaches the backend threshold, and the
+	// builtin kernels on the row table of the matrix otherwise. gemv on a matrix always
+	// runs the builtin kernel, as packing A would cost as much as the product; the
+	// backend gemv is there for callers that already hold contiguous data.
+	class compute_backend
+	{
+	public:
+		virtual ~compute_backend() {}
+
+		virtual backend_kind kind() const = 0;
+		virtual const char* name() const = 0;
+
+		// C = alpha * A * B + beta * C, where A is m x k, B is k x n and C is m x n.
+		virtual void gemm(Index m, Index n, Index k, float alpha, const float* a, Index lda,
+			const float* b, Index ldb, float beta, float* c, Index ldc) = 0;
+		virtual void gemm(Index m, Index n, Index k, double alpha, const double* a, Index lda,
+			const double* b, Index ldb, double beta, double* c, Index ldc) = 0;
+
+		// y = alpha * op(A) * x + beta * y, where A is m x n and op(A) is A or transpose(A).
+		virtual void gemv(bool transposed, Index m, Index n, float alpha, const float* a, Index lda,
+			const float* x, float beta, float* y) = 0;
+		virtual void gemv(bool transposed, Index m, Index n, double alpha, const double* a, Index lda,
+			const double* x, double beta, double* y) = 0;
+
+		// Solves T * X = B in place of B, where T is n x n triangular and B is n x nrhs.
+		virtual void trsm(triangle uplo, Index n, Index nrhs, const float* t, Index ldt, float* b, Index ldb) = 0;
+		virtual void trsm(triangle uplo, Index n, Index nrhs, const double* t, Index ldt, double* b, Index ldb) = 0;
+	};
+
+	namespace detail
+	{
+		template<class T>
+		struct non_deduced { using type = T; };
+		// keeps scalars and views out of template argument deduction, so that the element
+		// type is taken from the matrix and 1.0 or a std::vector convert implicitly
+		template<class T>
+		using non_deduced_t = typename non_deduced<T>::type;
+
+		template<class T>
+		constexpr bool is_blas_type_v = std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+		constexpr Index blas_lanes = 8;
+		// minimal number of matrix elements handed to one thread
+		constexpr Index blas_grain = Index(1) << 16;
+
+		inline Index blas_row_grain(Index cols) { return std::max<Index>(1, blas_grain / std::max<Index>(cols, 1)); }
+
+		// Dot product in independent lanes, which the compiler turns into SIMD registers.
+		template<class T>
+		T dot(const T* a, const T* b, Index n)
+		{
+			T acc[blas_lanes]{};
+			Index i = 0;
+			for (; i + blas_lanes <= n; i += blas_lanes)
+				for (Index l = 0; l < blas_lanes; ++l)
+					acc[l] += a[i + l] * b[i + l];
+
+			T s{};
+			for (Index l = 0; l < blas_lanes; ++l)
+				s += acc[l];
+			for (; i < n; ++i)
+				s += a[i] * b[i];
+			return s;
+		}
+
+		// y += alpha * x
+		template<class T>
+		void axpy(T alpha, const T* x, T* y, Index n)
+		{
+			for (Index i = 0; i < n; ++i)
+				y[i] += alpha * x[i];
+		}
+
+		// y = beta * y, where beta == 0 clears y whatever it holds (NaN included)
+		template<class T>
+		void scale(T beta, T* y, Index n)
+		{
+			if (beta == T{})
+				std::fill(y, y + n, T{});
+			else if (beta != T{ 1 })
+				for (Index i = 0; i < n; ++i)
+					y[i] *= beta;
+		}
+
+		// Builtin kernels, on row accessors (see Gemm.hpp) so that they run on the row
+		// table of a matrix as well as on contiguous buffers.
+		template<class T, class RowsA, class RowsB, class RowsC>
+		void builtin_gemm(Index m, Index n, Index k, T alpha, RowsA a, RowsB b, T beta, RowsC c)
+		{
+			parallel_for(0, m, gemm_block_m, [&](Index first, Index last) {
+				auto sub_a = [&](Index i) { return a(first + i); };
+				auto sub_c = [&](Index i) { return c(first + i); };
+
+				for (Index i = first; i < last; ++i)
+					scale(beta, c(i), n);
+				if (alpha == T{} || k == 0) return;
+
+				if (alpha == T{ 1 })
+				{
+					gemm_accumulate<T>(last - first, n, k, sub_a, b, sub_c);
+					return;
+				}
+				std::vector<T> tmp(static_cast<std::size_t>(last - first) * n);
+				gemm_accumulate<T>(last - first, n, k, sub_a, b, strided_rows<T>{ tmp.data(), n });
+				for (Index i = first; i < last; ++i)
+					axpy(alpha, tmp.data() + static_cast<std::ptrdiff_t>(i - first) * n, c(i), n);
+			});
+		}
+
+		template<class T, class Rows>
+		void builtin_gemv(bool transposed, Index m, Index n, T alpha, Rows a, const T* x, T beta, T* y)
+		{
+			if (!transposed)
+			{
+				parallel_for(0, m, blas_row_grain(n), [&](Index first, Index last) {
+					for (Index i = first; i < last; ++i)
+					{
+						const T d = alpha * dot(a(i), x, n);
+						y[i] = (beta == T{}) ? d : d + beta * y[i];
+					}
+				});
+				return;
+			}
+
+			// every thread owns a band of y, which stays in cache while the rows stream by
+			const Index band = std::max<Index>(64, blas_row_grain(m));
+			parallel_for(0, n, band, [&](Index first, Index last) {
+				T* yb = y + first;
+				scale(beta, yb, last - first);
+				for (Index r = 0; r < m; ++r)
+					axpy(alpha * x[r], a(r) + first, yb, last - first);
+			});
+		}
+
+		// Substitution row by row; every thread owns a band of columns of B.
+		template<class T, class RowsT, class RowsB>
+		void builtin_trsm(triangle uplo, Index n, Index nrhs, RowsT t, RowsB b)
+		{
+			for (Index i = 0; i < n; ++i)
+				if (t(i)[i] == T{})
+					throw std::domain_error{ "triangular matrix is singular" };
+
+			const Index band = std::max<Index>(16, blas_grain / std::max<Index>(1, n * n / 2));
+			parallel_for(0, nrhs, band, [&](Index first, Index last) {
+				const Index w = last - first;
+				for (Index s = 0; s < n; ++s)
+				{
+					const Index i = (uplo == triangle::lower) ? s : n - 1 - s;
+					T* bi = b(i) + first;
+					const T* ti = t(i);
+					const Index j0 = (uplo == triangle::lower) ? 0 : i + 1;
+					const Index j1 = (uplo == triangle::lower) ? i : n;
+					for (Index j = j0; j < j1; ++j)
+						axpy(-ti[j], b(j) + first, bi, w);
+
+					const T inv = T{ 1 } / ti[i];
+					for (Index c = 0; c < w; ++c)
+						bi[c] *= inv;
+				}
+			});
+		}
+	}
+
+	class builtin_backend final : public compute_backend
+	{
+	public:
+		backend_kind kind() const override { return backend_kind::builtin; }
+		const char* name() const override { return "builtin"; }
+
+		void gemm(Index m, Index n, Index k, float alpha, const float* a, Index lda,
+			const float* b, Index ldb, float beta, float* c, Index ldc) override { gemm_impl(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc); }
+		void gemm(Index m, Index n, Index k, double alpha, const double* a, Index lda,
+			const double* b, Index ldb, double beta, double* c, Index ldc) override { gemm_impl(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc); }
+
+		void gemv(bool transposed, Index m, Index n, float alpha, const float* a, Index lda,
+			const float* x, float beta, float* y) override { detail::builtin_gemv(transposed, m, n, alpha, strided_rows<const float>{ a, lda }, x, beta, y); }
+		void gemv(bool transposed, Index m, Index n, double alpha, const double* a, Index lda,
+			const double* x, double beta, double* y) override { detail::builtin_gemv(transposed, m, n, alpha, strided_rows<const double>{ a, lda }, x, beta, y); }
+
+		void trsm(triangle uplo, Index n, Index nrhs, const float* t, Index ldt, float* b, Index ldb) override
+		{ detail::builtin_trsm<float>(uplo, n, nrhs, strided_rows<const float>{ t, ldt }, strided_rows<float>{ b, ldb }); }
+		void trsm(triangle uplo, Index n, Index nrhs, const double* t, Index ldt, double* b, Index ldb) override
+		{ detail::builtin_trsm<double>(uplo, n, nrhs, strided_rows<const double>{ t, ldt }, strided_rows<double>{ b, ldb }); }
+
+	private:
+		template<class T>
+		static void gemm_impl(Index m, Index n, Index k, T alpha, const T* a, Index lda, const T* b, Index ldb, T beta, T* c, Index ldc)
+		{
+			detail::builtin_gemm(m, n, k, alpha, strided_rows<const T>{ a, lda }, strided_rows<const T>{ b, ldb }, beta, strided_rows<T>{ c, ldc });
+		}
+	};
+
+#if defined(MY_MATRIX_HAS_CBLAS)
+	class blas_backend final : public compute_backend
+	{
+	public:
+		backend_kind kind() const override { return backend_kind::blas; }
+		const char* name() const override { return "blas"; }
+
+		void gemm(Index m, Index n, Index k, float alpha, const float* a, Index lda,
+			const float* b, Index ldb, float beta, float* c, Index ldc) override
+		{
+			cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, to_int(m), to_int(n), to_int(k),
+				alpha, a, to_int(lda), b, to_int(ldb), beta, c, to_int(ldc));
+		}
+		void gemm(Index m, Index n, Index k, double alpha, const double* a, Index lda,
+			const double* b, Index ldb, double beta, double* c, Index ldc) override
+		{
+			cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, to_int(m), to_int(n), to_int(k),
+				alpha, a, to_int(lda), b, to_int(ldb), beta, c, to_int(ldc));
+		}
+
+		void gemv(bool transposed, Index m, Index n, float alpha, const float* a, Index lda,
+			const float* x, float beta, float* y) override
+		{
+			cblas_sgemv(CblasRowMajor, transposed ? CblasTrans : CblasNoTrans, to_int(m), to_int(n),
+				alpha, a, to_int(lda), x, 1, beta, y, 1);
+		}
+		void gemv(bool transposed, Index m, Index n, double alpha, const double* a, Index lda,
+			const double* x, double beta, double* y) override
+		{
+			cblas_dgemv(CblasRowMajor, transposed ? CblasTrans : CblasNoTrans, to_int(m), to_int(n),
+				alpha, a, to_int(lda), x, 1, beta, y, 1);
+		}
+
+		void trsm(triangle uplo, Index n, Index nrhs, const float* t, Index ldt, float* b, Index ldb) override
+		{
+			cblas_strsm(CblasRowMajor, CblasLeft, uplo == triangle::lower ? CblasLower : CblasUpper, CblasNoTrans, CblasNonUnit,
+				to_int(n), to_int(nrhs), 1.0f, t, to_int(ldt), b, to_int(ldb));
+		}
+		void trsm(triangle uplo, Index n, Index nrhs, const double* t, Index ldt, double* b, Index ldb) override
+		{
+			cblas_dtrsm(CblasRowMajor, CblasLeft, uplo == triangle::lower ? CblasLower : CblasUpper, CblasNoTrans, CblasNonUnit,
+				to_int(n), to_int(nrhs), 1.0, t, to_int(ldt), b, to_int(ldb));
+		}
+
+	private:
+		static int to_int(Index x)
+		{
+			if (x > INT_MAX)
+				throw std::length_error{ "matrix is too large for the BLAS interface" };
+			return static_cast<int>(x);
+		}
+	};
+#endif
+
+	namespace detail
+	{
+		struct backend_registry
+		{
+			std::atomic<compute_backend*> active;
+			// m*n*k of a 64^3 product: below it the call and packing overhead dominates
+			std::atomic<std::int64_t> threshold{ std::int64_t(64) * 64 * 64 };
+		};
+
+		inline builtin_backend& builtin_instance()
+		{
+			static builtin_backend instance;
+			return instance;
+		}
+
+		inline compute_backend* find_backend(backend_kind k)
+		{
+			if (k == backend_kind::builtin)
+				return &builtin_instance();
+#if defined(MY_MATRIX_HAS_CBLAS)
+			static blas_backend blas;
+			return &blas;
+#else
+			return nullptr;
+#endif
+		}
+
+		// The initial backend may be chosen with the environment variable MY_MATRIX_BACKEND
+		// ("builtin" or "blas"); an unavailable choice falls back to builtin.
+		inline backend_registry& registry()
+		{
+			static backend_registry r{ [] {
+				const char* env = std::getenv("MY_MATRIX_BACKEND");
+				compute_backend* be = (env != nullptr && std::strcmp(env, "blas") == 0) ? find_backend(backend_kind::blas) : nullptr;
+				return be != nullptr ? be : find_backend(backend_kind::builtin);
+			}() };
+			return r;
+		}
+
+		// Backend to call for 'work', or null for the builtin kernels on the row table. Work is
+		// counted in 64 bits: m*n*k overflows a 32-bit Index long before the operands do.
+		template<class T>
+		compute_backend* routed_backend(std::int64_t work)
+		{
+			if constexpr (!is_blas_type_v<T>)
+				return nullptr;
+			else
+			{
+				auto& r = registry();
+				compute_backend* be = r.active.load(std::memory_order_acquire);
+				if (be->kind() == backend_kind::builtin || work <= 0 || work < r.threshold.load(std::memory_order_relaxed))
+					return nullptr;
+				return be;
+			}
+		}
+
+		// Contiguous row-major image of a matrix for a backend call. Every row of a matrix is
+		// a separate allocation, so only a single row is used in place; anything larger is
+		// packed into a copy.
+		template<class T>
+		class packed_rows
+		{
+		public:
+			template<class A>
+			packed_rows(const matrix<T, A>& mtx, bool copy_in = true)
+			{
+				const Index rows = mtx.count_rows();
+				const Index cols = mtx.count_cols();
+				if (rows == 1)
+				{
+					ld_ = std::max<Index>(cols, 1);
+					ptr = const_cast<T*>(mtx.data()[0]);
+					return;
+				}
+
+				ld_ = std::max<Index>(cols, 1);
+				buf.resize(static_cast<std::size_t>(rows) * ld_);
+				if (copy_in)
+					for (Index i = 0; i < rows; ++i)
+						std::copy(mtx.data()[i], mtx.data()[i] + cols, buf.data() + static_cast<std::ptrdiff_t>(i) * ld_);
+				ptr = buf.data();
+			}
+
+			T* data() const { return ptr; }
+			Index ld() const { return ld_; }
+
+			// Copies a packed result back into the matrix it was made from.
+			template<class A>
+			void store(matrix<T, A>& mtx) const
+			{
+				if (buf.empty()) return;
+				for (Index i = 0; i < mtx.count_rows(); ++i)
+					std::copy(buf.data() + static_cast<std::ptrdiff_t>(i) * ld_, buf.data() + static_cast<std::ptrdiff_t>(i) * ld_ + mtx.count_cols(), mtx.data()[i]);
+			}
+
+		private:
+			std::vector<T> buf;
+			T* ptr{};
+			Index ld_{};
+		};
+	}
+
+	inline bool is_backend_available(backend_kind k) { return detail::find_backend(k) != nullptr; }
+
+	// Selects the backend used by the routed functions, for all threads.
+	inline void set_backend(backend_kind k)
+	{
+		compute_backend* be = detail::find_backend(k);
+		if (be == nullptr)
+			throw std::invalid_argument{ "backend is not available in this build" };
+		detail::registry().active.store(be, std::memory_order_release);
+	}
+	inline compute_backend& active_backend() { return *detail::registry().active.load(std::memory_order_acquire); }
+	inline compute_backend& get_backend(backend_kind k)
+	{
+		compute_backend* be = detail::find_backend(k);
+		if (be == nullptr)
+			throw std::invalid_argument{ "backend is not available in this build" };
+		return *be;
+	}
+
+	// Smallest amount of work routed to a non-builtin backend.
+	inline void set_backend_threshold(std::int64_t work) { detail::registry().threshold.store(std::max<std::int64_t>(work, 0), std::memory_order_relaxed); }
+	inline std::int64_t backend_threshold() { return detail::registry().threshold.load(std::memory_order_relaxed); }
+
+	// C = alpha * A * B + beta * C. C must not share storage with A or B. Matrices whose
+	// rows are not contiguous are packed for a backend call, which is cheap next to the
+	// product.
+	template<class T, class A>
+	void gemm(detail::non_deduced_t<T> alpha, const matrix<T, A>& a, const matrix<T, A>& b,
+		detail::non_deduced_t<T> beta, matrix<T, A>& c)
+	{
+		if (a.count_cols() != b.count_rows())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+		if (c.count_rows() != a.count_rows() || c.count_cols() != b.count_cols())
+			throw std::invalid_argument{ "result matrix has wrong size" };
+
+		const Index m = a.count_rows();
+		const Index n = b.count_cols();
+		const Index k = a.count_cols();
+		if (m == 0 || n == 0) return;
+
+		if constexpr (detail::is_blas_type_v<T>)
+		{
+			if (compute_backend* be = detail::routed_backend<T>(std::int64_t(m) * n * k))
+			{
+				const detail::packed_rows<T> pa(a);
+				const detail::packed_rows<T> pb(b);
+				const detail::packed_rows<T> pc(c, beta != T{});
+				be->gemm(m, n, k, alpha, pa.data(), pa.ld(), pb.data(), pb.ld(), beta, pc.data(), pc.ld());
+				pc.store(c);
+				return;
+			}
+		}
+		detail::builtin_gemm<T>(m, n, k, alpha, table_rows<const T>{ a.data(), 0 }, table_rows<const T>{ b.data(), 0 },
+			beta, table_rows<T>{ c.data(), 0 });
+	}
+
+	// Product of two matrices, gemm(1, a, b, 0, result): on the active backend for large
+	// float and double operands, with the blocked kernels of Gemm.hpp otherwise.
+	template<class T, class A>
+	matrix<T, A> multiply(const matrix<T, A>& a, const matrix<T, A>& b)
+	{
+		if (a.count_cols() != b.count_rows())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+
+		matrix<T, A> result(a.count_rows(), b.count_cols());
+		gemm(T{ 1 }, a, b, T{}, result);
+		return result;
+	}
+
+	// Solves T * X = B for X in place of B, T being square and lower or upper triangular
+	// (the other triangle is not read). Throws std::domain_error if T is singular.
+	template<class T, class A>
+	void solve_triangular(const matrix<T, A>& t, matrix<T, A>& b, triangle uplo = triangle::lower)
+	{
+		const Index n = t.count_rows();
+		if (t.count_cols() != n)
+			throw std::invalid_argument{ "triangular matrix must be square" };
+		if (b.count_rows() != n)
+			throw std::invalid_argument{ "rows count of right-hand side is not equal to matrix size" };
+
+		const Index nrhs = b.count_cols();
+		if (n == 0 || nrhs == 0) return;
+
+		if constexpr (detail::is_blas_type_v<T>)
+		{
+			if (compute_backend* be = detail::routed_backend<T>(std::int64_t(n) * n * nrhs))
+			{
+				for (Index i = 0; i < n; ++i)
+					if (t.data()[i][i] == T{})
+						throw std::domain_error{ "triangular matrix is singular" };
+
+				const detail::packed_rows<T> pt(t);
+				const detail::packed_rows<T> pb(b);
+				be->trsm(uplo, n, nrhs, pt.data(), pt.ld(), pb.data(), pb.ld());
+				pb.store(b);
+				return;
+			}
+		}
+		detail::builtin_trsm<T>(uplo, n, nrhs, table_rows<const T>{ t.data(), 0 }, table_rows<T>{ b.data(), 0 });
+	}
+}
+
+#endif // BACKEND_HPP
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef BACKEND_BENCHMARK_HPP
+#define BACKEND_BENCHMARK_HPP
+
+#include<chrono>
+#include<cstdint>
+#include<vector>
+#include<algorithm>
+#include<ostream>
+#include<initializer_list>
+
+#include"Matrix.hpp"
+#include"Backend.hpp"
+#include"SimpleTimer.hpp"
+
+namespace my
+{
+	// Times the routed gemm and solve_triangular (including packing) and the gemv kernel
+	// (on A packed beforehand) of every available backend on n x n matrices of T, best of
+	// 'repeats' runs, and prints one line per size and backend:
+	//
+	//     n  backend  gemm_us  gemv_us  trsm_us  gemm_gflops
+	//
+	// The threshold is lowered to 0 for the run and the active backend and threshold are
+	// restored afterwards.
+	template<class T>
+	void benchmark_backends(std::ostream& os, std::initializer_list<Index> sizes, Index repeats = 3)
+	{
+		compute_backend& previous = active_backend();
+		const std::int64_t previous_threshold = backend_threshold();
+		set_backend_threshold(0);
+
+		os << "n\tbackend\tgemm_us\tgemv_us\ttrsm_us\tgemm_gflops" << std::endl;
+		for (Index n : sizes)
+		{
+			matrix<T> a(n, n);
+			matrix<T> b(n, n);
+			matrix<T> lower(n, n, T{});
+			for (Index i = 0; i < n; ++i)
+				for (Index j = 0; j < n; ++j)
+				{
+					a.data()[i][j] = static_cast<T>((i * 7 + j * 3) % 11) / T{ 11 };
+					b.data()[i][j] = static_cast<T>((i * 5 + j) % 13) / T{ 13 };
+					if (j < i) lower.data()[i][j] = a.data()[i][j] / static_cast<T>(n);
+				}
+			for (Index i = 0; i < n; ++i)
+				lower.data()[i][i] = T{ 1 };
+			std::vector<T> x(n, T{ 1 });
+			std::vector<T> y(n);
+			std::vector<T> packed_a(static_cast<std::size_t>(n) * n);
+			for (Index i = 0; i < n; ++i)
+				std::copy(a.data()[i], a.data()[i] + n, packed_a.data() + static_cast<std::ptrdiff_t>(i) * n);
+
+			for (backend_kind k : { backend_kind::builtin, backend_kind::blas })
+			{
+				if (!is_backend_available(k)) continue;
+				set_backend(k);
+
+				auto best = [&](auto run) {
+					long long result = -1;
+					for (Index r = 0; r < repeats; ++r)
+					{
+						SimpleTimer<std::chrono::microseconds> timer(os, false, false);
+						run();
+						const long long t = timer.elapsed_time().count();
+						if (result < 0 || t < result) result = t;
+					}
+					return result;
+				};
+
+				matrix<T> c(n, n);
+				const long long t_gemm = best([&] { gemm(T{ 1 }, a, b, T{}, c); });
+				const long long t_gemv = best([&] { active_backend().gemv(false, n, n, T{ 1 }, packed_a.data(), std::max<Index>(n, 1), x.data(), T{}, y.data()); });
+				const long long t_trsm = best([&] { matrix<T> rhs = b; solve_triangular(lower, rhs, triangle::lower); });
+
+				const double gflops = t_gemm > 0 ? 2.0 * n * n * n / (t_gemm * 1e3) : 0.0;
+				os << n << '\t' << active_backend().name() << '\t' << t_gemm << '\t' << t_gemv << '\t' << t_trsm << '\t' << gflops << std::endl;
+			}
+		}
+
+		set_backend(previous.kind());
+		set_backend_threshold(previous_threshold);
+	}
+}
+
+#endif // BACKEND_BENCHMARK_HPP
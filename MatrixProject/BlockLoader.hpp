@@ -0,0 +1,329 @@
+#pragma once
+#ifndef BLOCK_LOADER_HPP
+#define BLOCK_LOADER_HPP
+
+#include<deque>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+#include<fstream>
+#include<functional>
+#include<optional>
+#include<exception>
+#include<stdexcept>
+#include<type_traits>
+#include<condition_variable>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include<coroutine>
+#define MY_BLOCK_LOADER_COROUTINES 1
+#endif
+
+#include"Matrix.hpp"
+
+namespace my
+{
+	// binary: rows of count_cols() raw T values, back to back, no header;
+	// text:   values separated by whitespace (line breaks are not significant).
+	enum class file_format { binary, text };
+
+	// Reads a matrix file in blocks of rows on a background thread while the consumer
+	// processes earlier blocks. Blocks are 'ring_size' matrices allocated up front and
+	// reused: when all of them are loaded and not yet released by the consumer the reader
+	// waits (backpressure), so memory use is bounded whatever the file size.
+	//
+	//     block_loader<double> loader("data.bin", file_format::binary, cols);
+	//     while (auto b = loader.next_block())
+	//         process(b->data(), b->count_rows());
+	//
+	// Errors of the reader thread (I/O, malformed input) are rethrown by next_block.
+	template<class T, class A = std::allocator<T>>
+	class block_loader
+	{
+	public:
+		// Loaded block, returned to the ring when destroyed.
+		class block
+		{
+			friend class block_loader;
+		public:
+			block(block&& other) noexcept : owner{ other.owner }, slot{ other.slot } { other.owner = nullptr; }
+			block& operator=(block&& other) noexcept
+			{
+				if (this == &other) return *this;
+				release();
+				owner = other.owner;
+				slot = other.slot;
+				other.owner = nullptr;
+				return *this;
+			}
+			block(const block&) = delete;
+			block& operator=(const block&) = delete;
+			~block() { release(); }
+
+			// Only the first count_rows() rows of data() belong to this block.
+			const matrix<T, A>& data() const { return owner->blocks[slot]; }
+			Index count_rows() const { return owner->filled[slot]; }
+			// Index of the first row of the block in the file.
+			Index first_row() const { return owner->first[slot]; }
+
+			void release()
+			{
+				if (owner == nullptr) return;
+				owner->recycle(slot);
+				owner = nullptr;
+			}
+
+		private:
+			block(block_loader* owner, Index slot) : owner{ owner }, slot{ slot } {}
+
+			block_loader* owner{};
+			Index slot{};
+		};
+
+		explicit block_loader(const std::string& path, file_format format, Index cols, Index block_rows = 4096, Index ring_size = 3)
+			: format{ format }, cols{ cols }, block_rows{ block_rows }
+		{
+			if (cols <= 0 || block_rows <= 0 || ring_size <= 0)
+				throw std::invalid_argument{ "block_loader size arguments must be positive" };
+			if (format == file_format::binary && !std::is_trivially_copyable_v<T>)
+				throw std::invalid_argument{ "binary block_loader requires a trivially copyable element type" };
+
+			in.open(path, format == file_format::binary ? std::ios::binary : std::ios::in);
+			if (!in)
+				throw std::runtime_error{ "unable to open matrix file: " + path };
+
+			blocks.reserve(ring_size);
+			for (Index i = 0; i < ring_size; ++i)
+			{
+				blocks.emplace_back(block_rows, cols);
+				free_slots.push_back(i);
+			}
+			filled.assign(ring_size, 0);
+			first.assign(ring_size, 0);
+
+			worker = std::thread(&block_loader::run, this);
+		}
+
+		block_loader(const block_loader&) = delete;
+		block_loader& operator=(const block_loader&) = delete;
+
+		// Blocks handed out must be released before the loader is destroyed.
+		~block_loader()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				stopping = true;
+			}
+			cv.notify_all();
+			worker.join();
+		}
+
+		// Waits for the next block; empty at the end of the file.
+		std::optional<block> next_block()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this] { return !ready.empty() || finished; });
+			return take(lock);
+		}
+
+		// Returns the next block if it is already loaded, without waiting.
+		std::optional<block> try_next_block()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			if (ready.empty() && !finished)
+				return std::nullopt;
+			return take(lock);
+		}
+
+#if defined(MY_BLOCK_LOADER_COROUTINES)
+		// Schedules a suspended coroutine, e.g. by posting the handle to a thread pool or to the
+		// consumer's event loop. It is called on the reader thread and must not throw; calling
+		// h.resume() directly would run the consumer inside the reader loop again.
+		using executor = std::function<void(std::coroutine_handle<>)>;
+
+		// co_await loader.async_next_block(ex) suspends the calling coroutine until a block is
+		// loaded or the reader has finished; the reader then hands the coroutine to 'ex' and
+		// goes on reading, so I/O overlaps with the consumer. The loader must outlive the
+		// resumption. One waiting coroutine at a time, and no concurrent next_block calls
+		// while it waits.
+		struct block_awaiter
+		{
+			block_loader* self;
+			executor ex;
+
+			bool await_ready()
+			{
+				std::lock_guard<std::mutex> lock(self->mtx);
+				return !self->ready.empty() || self->finished;
+			}
+			bool await_suspend(std::coroutine_handle<> h)
+			{
+				std::lock_guard<std::mutex> lock(self->mtx);
+				if (!self->ready.empty() || self->finished)
+					return false;
+				self->waiter = h;
+				self->waiter_executor = std::move(ex);
+				return true;
+			}
+			// Never waits: the coroutine only runs once a block is ready or the reader has
+			// finished (with the error, if any, already set).
+			std::optional<block> await_resume()
+			{
+				std::unique_lock<std::mutex> lock(self->mtx);
+				return self->take(lock);
+			}
+		};
+
+		block_awaiter async_next_block(executor ex)
+		{
+			if (!ex)
+				throw std::invalid_argument{ "async_next_block requires an executor" };
+			return block_awaiter{ this, std::move(ex) };
+		}
+#endif
+
+	private:
+		std::optional<block> take(std::unique_lock<std::mutex>&)
+		{
+			if (!ready.empty())
+			{
+				const Index slot = ready.front();
+				ready.pop_front();
+				return block(this, slot);
+			}
+			if (error)
+				std::rethrow_exception(error);
+			return std::nullopt;
+		}
+
+		void recycle(Index slot)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				free_slots.push_back(slot);
+			}
+			cv.notify_all();
+		}
+
+		// Fills a block, returns the number of rows read (less than block_rows at the end).
+		Index read_block(matrix<T, A>& dst)
+		{
+			T* const* rows = dst.data();
+			Index r = 0;
+			for (; r < block_rows; ++r)
+			{
+				if (format == file_format::binary)
+				{
+					const std::streamsize bytes = static_cast<std::streamsize>(sizeof(T)) * cols;
+					in.read(reinterpret_cast<char*>(rows[r]), bytes);
+					if (in.gcount() == 0 && in.eof())
+						break;
+					if (in.gcount() != bytes)
+						throw std::runtime_error{ "matrix file ends in the middle of a row" };
+				}
+				else
+				{
+					if (!(in >> rows[r][0]))
+					{
+						if (in.eof()) break;
+						throw std::runtime_error{ "malformed value in matrix file" };
+					}
+					for (Index j = 1; j < cols; ++j)
+						if (!(in >> rows[r][j]))
+							throw std::runtime_error{ in.eof() ? "matrix file ends in the middle of a row" : "malformed value in matrix file" };
+				}
+			}
+			return r;
+		}
+
+		void run()
+		{
+			Index row = 0;
+			std::exception_ptr failure;
+			try {
+				for (;;)
+				{
+					Index slot;
+					{
+						std::unique_lock<std::mutex> lock(mtx);
+						cv.wait(lock, [this] { return !free_slots.empty() || stopping; });
+						if (stopping) break;
+						slot = free_slots.front();
+						free_slots.pop_front();
+					}
+
+					const Index n = read_block(blocks[slot]);
+					if (n == 0)
+					{
+						std::lock_guard<std::mutex> lock(mtx);
+						free_slots.push_back(slot);
+						break;
+					}
+
+					filled[slot] = n;
+					first[slot] = row;
+					row += n;
+					publish([&] { ready.push_back(slot); });
+
+					if (n < block_rows) break;
+				}
+			}
+			catch (...) {
+				failure = std::current_exception();
+			}
+			// error and finished change together, so a consumer woken by this sees both
+			publish([&] {
+				error = failure;
+				finished = true;
+			});
+		}
+
+		template<class F>
+		void publish(F change)
+		{
+#if defined(MY_BLOCK_LOADER_COROUTINES)
+			std::coroutine_handle<> h;
+			executor ex;
+#endif
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				change();
+#if defined(MY_BLOCK_LOADER_COROUTINES)
+				h = waiter;
+				waiter = nullptr;
+				ex = std::move(waiter_executor);
+				waiter_executor = nullptr;
+#endif
+			}
+			cv.notify_all();
+#if defined(MY_BLOCK_LOADER_COROUTINES)
+			if (h) ex(h);
+#endif
+		}
+
+		file_format format;
+		Index cols{};
+		Index block_rows{};
+		std::ifstream in;
+
+		std::vector<matrix<T, A>> blocks;
+		std::vector<Index> filled;
+		std::vector<Index> first;
+		std::deque<Index> free_slots;
+		std::deque<Index> ready;
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool finished{ false };
+		bool stopping{ false };
+		std::exception_ptr error;
+#if defined(MY_BLOCK_LOADER_COROUTINES)
+		std::coroutine_handle<> waiter;
+		executor waiter_executor;
+#endif
+		std::thread worker;
+	};
+}
+
+#endif // BLOCK_LOADER_HPP
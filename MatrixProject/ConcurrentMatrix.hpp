@@ -0,0 +1,290 @@
+#pragma once
+#ifndef CONCURRENT_MATRIX_HPP
+#define CONCURRENT_MATRIX_HPP
+
+#include<atomic>
+#include<thread>
+#include<cstdint>
+#include<memory>
+#include<iterator>
+#include<stdexcept>
+#include<algorithm>
+#include<type_traits>
+
+#include"Matrix.hpp"
+
+namespace my
+{
+	// Matrix with a fixed number of columns into which many threads append rows at once
+	// without locks. A writer claims a row index with a CAS on a counter, fills the row in
+	// place and publishes it with a per-row flag. Rows live in segments whose sizes double
+	// (first_segment_rows, 2 * first_segment_rows, ...); the segment table has a fixed size,
+	// so it never moves and readers are never stopped while the matrix grows. The first
+	// writer that needs a new segment claims it with a CAS and allocates it; writers that
+	// need the same segment meanwhile wait for it.
+	//
+	// Rows are published out of order: row(i) may be read once is_ready(i) is true, and
+	// published_rows() is the length of the prefix of rows that are all settled. A row
+	// whose copy threw is settled as failed (is_failed) and holds no data.
+	template<class T, class A = std::allocator<T>>
+	class concurrent_matrix
+	{
+		static_assert(std::is_nothrow_default_constructible_v<T> && std::is_nothrow_copy_assignable_v<T>,
+			"concurrent_matrix requires nothrow default construction and copy assignment");
+
+	public:
+		using allocator_type = A;
+		using size_type = Index;
+		using value_type = T;
+
+		static constexpr Index max_segments = 40;
+
+		explicit concurrent_matrix(Index cols, Index first_segment_rows = 1024, const allocator_type& al = allocator_type())
+			: cols{ cols }, first_rows{ first_segment_rows }, alloc{ al }, flag_alloc{ al }
+		{
+			if (cols < 0)
+				throw std::invalid_argument{ "matrix_size arguments must be positive" };
+			if (first_segment_rows < 1)
+				throw std::invalid_argument{ "concurrent_matrix segment size must be positive" };
+
+			for (auto& s : segments)
+				s.store(nullptr, std::memory_order_relaxed);
+			for (auto& f : flags)
+				f.store(nullptr, std::memory_order_relaxed);
+		}
+
+		concurrent_matrix(const concurrent_matrix&) = delete;
+		concurrent_matrix& operator=(const concurrent_matrix&) = delete;
+
+		~concurrent_matrix()
+		{
+			for (Index s = 0; s < max_segments; ++s)
+				free_segment(s, segments[s].load(std::memory_order_relaxed), flags[s].load(std::memory_order_relaxed));
+		}
+
+		Index count_cols() const { return cols; }
+
+		// Number of rows claimed by writers so far, some of them may not be ready yet.
+		Index claimed_rows() const { return next.load(std::memory_order_acquire); }
+
+		// Length of the longest prefix of rows that are all settled, ready or failed.
+		Index published_rows() const
+		{
+			Index p = prefix.load(std::memory_order_acquire);
+			const Index claimed = claimed_rows();
+			Index q = p;
+			while (q < claimed && row_state(q) != row_pending)
+				++q;
+
+			// advance the shared prefix so later calls do not rescan
+			while (q > p && !prefix.compare_exchange_weak(p, q, std::memory_order_acq_rel))
+				if (p >= q) return p;
+			return q;
+		}
+
+		bool is_ready(Index x) const
+		{
+			if (x < 0 || x >= claimed_rows()) return false;
+			return row_state(x) == row_ready;
+		}
+
+		// True if the copy of row x threw in add_row; the row has no data.
+		bool is_failed(Index x) const
+		{
+			if (x < 0 || x >= claimed_rows()) return false;
+			return row_state(x) == row_failed;
+		}
+
+		// Appends a row, safe to call from any number of threads. Returns its index.
+		template<class It>
+		Index add_row(It first, It last)
+		{
+			if (std::distance(first, last) != cols)
+				throw std::out_of_range{ "columns count is not equal to new row" };
+
+			// The segment of the next index is acquired before the index is claimed, so a
+			// failed allocation leaves no claimed row that would never be published.
+			Index x = next.load(std::memory_order_acquire);
+			location loc;
+			T* seg;
+			do {
+				loc = locate(x);
+				seg = acquire_segment(loc.segment);
+			} while (!next.compare_exchange_weak(x, x + 1, std::memory_order_acq_rel));
+			T* dst = seg + static_cast<std::size_t>(loc.offset) * cols;
+
+			try {
+				for (Index j = 0; j < cols; ++j, ++first)
+					dst[j] = *first;
+			}
+			catch (...) {
+				// settle the row so published_rows() can move past it
+				publish(loc, row_failed);
+				throw;
+			}
+			publish(loc, row_ready);
+			return x;
+		}
+		template<class Container>
+		Index add_row(const Container& cont) { return add_row(std::cbegin(cont), std::cend(cont)); }
+
+		// Row x, which must be published (see is_ready).
+		const T* row(Index x) const
+		{
+			if (!is_ready(x))
+				throw std::out_of_range{ "row of concurrent_matrix is not published" };
+
+			const auto loc = locate(x);
+			return segments[loc.segment].load(std::memory_order_acquire) + static_cast<std::size_t>(loc.offset) * cols;
+		}
+
+		const T& at(Index x, Index y) const
+		{
+			if (y < 0 || y >= cols)
+				throw std::out_of_range{ "index is out of range of matrix" };
+			return row(x)[y];
+		}
+
+		// Copies the ready rows of the published prefix, in order and without the failed
+		// ones, into an ordinary matrix.
+		template<class MA = A>
+		matrix<T, MA> to_matrix() const
+		{
+			const Index n = published_rows();
+			Index ready = 0;
+			for (Index i = 0; i < n; ++i)
+				if (row_state(i) == row_ready) ++ready;
+
+			matrix<T, MA> result(ready, cols);
+			for (Index i = 0, k = 0; i < n; ++i)
+				if (row_state(i) == row_ready)
+					std::copy(row(i), row(i) + cols, result.data()[k++]);
+			return result;
+		}
+
+	private:
+		using elem_traits = std::allocator_traits<allocator_type>;
+		using flag_allocator = typename elem_traits::template rebind_alloc<std::atomic<unsigned char>>;
+		using flag_traits = std::allocator_traits<flag_allocator>;
+
+		struct location
+		{
+			Index segment{};
+			Index offset{};
+		};
+
+		std::int64_t segment_rows(Index s) const { return std::int64_t(first_rows) << s; }
+
+		// Segment s starts at row first_rows * (2^s - 1).
+		location locate(Index x) const
+		{
+			const std::int64_t q = x / first_rows + 1;
+			Index s = 0;
+			while ((std::int64_t(2) << s) <= q)
+				++s;
+			return { s, static_cast<Index>(x - std::int64_t(first_rows) * ((std::int64_t(1) << s) - 1)) };
+		}
+
+		static constexpr unsigned char row_pending = 0;
+		static constexpr unsigned char row_ready = 1;
+		static constexpr unsigned char row_failed = 2;
+
+		unsigned char row_state(Index x) const
+		{
+			const auto loc = locate(x);
+			const auto* f = flags[loc.segment].load(std::memory_order_acquire);
+			return f != nullptr ? f[loc.offset].load(std::memory_order_acquire) : row_pending;
+		}
+
+		void publish(location loc, unsigned char state)
+		{
+			flags[loc.segment].load(std::memory_order_acquire)[loc.offset].store(state, std::memory_order_release);
+		}
+
+		// Placeholder stored in segments[s] while one writer allocates segment s.
+		T* building_marker() { return reinterpret_cast<T*>(&building_tag); }
+
+		T* acquire_segment(Index s)
+		{
+			if (s >= max_segments)
+				throw std::length_error{ "concurrent_matrix is full" };
+
+			// Only the writer whose CAS installs the placeholder allocates; the others wait
+			// for it, and try again themselves if its allocation fails.
+			T* seg = segments[s].load(std::memory_order_acquire);
+			while (seg == nullptr || seg == building_marker())
+			{
+				if (seg == nullptr)
+				{
+					if (segments[s].compare_exchange_weak(seg, building_marker(), std::memory_order_acq_rel))
+						return build_segment(s);
+				}
+				else
+				{
+					std::this_thread::yield();
+					seg = segments[s].load(std::memory_order_acquire);
+				}
+			}
+			// the flags are installed before the segment, so they are visible now
+			return seg;
+		}
+
+		T* build_segment(Index s)
+		{
+			const std::size_t n = static_cast<std::size_t>(segment_rows(s));
+			const std::size_t elems = n * static_cast<std::size_t>(cols);
+
+			T* fresh = nullptr;
+			std::atomic<unsigned char>* fresh_flags = nullptr;
+			try {
+				if (elems) fresh = elem_traits::allocate(alloc, elems);
+				fresh_flags = flag_traits::allocate(flag_alloc, n);
+			}
+			catch (...) {
+				if (fresh != nullptr) elem_traits::deallocate(alloc, fresh, elems);
+				segments[s].store(nullptr, std::memory_order_release);
+				throw;
+			}
+			for (std::size_t i = 0; i < elems; ++i)
+				elem_traits::construct(alloc, fresh + i);
+			for (std::size_t i = 0; i < n; ++i)
+				flag_traits::construct(flag_alloc, fresh_flags + i, static_cast<unsigned char>(0));
+
+			// A zero-column matrix has no element storage; use the flags as a non-null marker.
+			T* seg = fresh != nullptr ? fresh : reinterpret_cast<T*>(fresh_flags);
+			flags[s].store(fresh_flags, std::memory_order_release);
+			segments[s].store(seg, std::memory_order_release);
+			return seg;
+		}
+
+		void destroy_elems(T* p, std::size_t elems)
+		{
+			if (p == nullptr) return;
+			for (std::size_t i = 0; i < elems; ++i)
+				elem_traits::destroy(alloc, p + i);
+			elem_traits::deallocate(alloc, p, elems);
+		}
+
+		void free_segment(Index s, T* seg, std::atomic<unsigned char>* f)
+		{
+			if (f == nullptr) return;
+
+			const std::size_t n = static_cast<std::size_t>(segment_rows(s));
+			if (cols > 0 && seg != nullptr)
+				destroy_elems(seg, n * static_cast<std::size_t>(cols));
+			flag_traits::deallocate(flag_alloc, f, n);
+		}
+
+		Index cols{};
+		Index first_rows{};
+		std::atomic<Index> next{ 0 };
+		mutable std::atomic<Index> prefix{ 0 };
+		std::atomic<T*> segments[max_segments];
+		std::atomic<std::atomic<unsigned char>*> flags[max_segments];
+		allocator_type alloc;
+		flag_allocator flag_alloc;
+		alignas(T) unsigned char building_tag{};
+	};
+}
+
+#endif // CONCURRENT_MATRIX_HPP
@@ -0,0 +1,282 @@
+#pragma once
+#ifndef COW_MATRIX_HPP
+#define COW_MATRIX_HPP
+
+#include<atomic>
+#include<memory>
+#include<vector>
+#include<iterator>
+#include<stdexcept>
+#include<algorithm>
+
+#include"Matrix.hpp"
+
+namespace my
+{
+	// Matrix whose rows are reference counted and shared between copies. Copying a
+	// cow_matrix copies only its row table (O(rows) pointer copies); the first write to a
+	// row that is still shared with another copy clones that row alone. This makes cheap
+	// read-only snapshots for other threads: copying and reading a cow_matrix concurrently
+	// is safe, writing is safe once every thread works on its own copy.
+	//
+	// Non-const element access is a write and may clone the row, so read through a const
+	// reference (std::as_const) where no modification is intended.
+	template<class T, class A = std::allocator<T>>
+	class cow_matrix
+	{
+	public:
+		using allocator_type = A;
+		using size_type = Index;
+		using value_type = T;
+
+		cow_matrix() {}
+		explicit cow_matrix(const allocator_type& al) : alloc{ al } {}
+		explicit cow_matrix(Index x, Index y, const value_type& val = value_type(), const allocator_type& al = allocator_type())
+			: cols{ y }, alloc{ al }
+		{
+			if (x < 0 || y < 0)
+				throw std::invalid_argument{ "matrix_size arguments must be positive" };
+
+			rows.reserve(x);
+			table.reserve(x);
+			for (Index i = 0; i < x; ++i)
+				push_row(make_filled_row(val));
+		}
+		template<class MA>
+		explicit cow_matrix(const matrix<T, MA>& mtx, const allocator_type& al = allocator_type())
+			: cols{ mtx.count_cols() }, alloc{ al }
+		{
+			rows.reserve(mtx.count_rows());
+			table.reserve(mtx.count_rows());
+			for (Index i = 0; i < mtx.count_rows(); ++i)
+				push_row(make_row(mtx.data()[i]));
+		}
+
+		Index count_rows() const { return static_cast<Index>(rows.size()); }
+		Index count_cols() const { return cols; }
+
+		const T* const* data() const { return table.data(); }
+
+		const T* row(Index x) const
+		{
+			range_check(x, count_rows());
+			return table[x];
+		}
+		// Pointer to a row that is owned by this copy only (cloned first if it was shared).
+		T* mutable_row(Index x)
+		{
+			range_check(x, count_rows());
+			unshare(x);
+			return table[x];
+		}
+
+		const T* operator[](Index x) const { return row(x); }
+		T* operator[](Index x) { return mutable_row(x); }
+
+		const T& at(Index x, Index y) const
+		{
+			range_check(y, cols);
+			return row(x)[y];
+		}
+		T& at(Index x, Index y)
+		{
+			range_check(y, cols);
+			return mutable_row(x)[y];
+		}
+
+		// Whether row x is currently shared with another copy.
+		bool is_shared(Index x) const
+		{
+			range_check(x, count_rows());
+			return rows[x].shared();
+		}
+
+		// Makes every row owned by this copy only.
+		void detach()
+		{
+			for (Index i = 0; i < count_rows(); ++i)
+				unshare(i);
+		}
+
+		void swap_rows(Index r1, Index r2)
+		{
+			range_check(r1, count_rows());
+			range_check(r2, count_rows());
+			std::swap(rows[r1], rows[r2]);
+			std::swap(table[r1], table[r2]);
+		}
+
+		template<class It>
+		void assign_row(Index x, It first, It last)
+		{
+			range_check(x, count_rows());
+			if (std::distance(first, last) != cols)
+				throw std::length_error{ "matrix row should be equal to this range by length" };
+
+			// a fresh row is cheaper than cloning one that is about to be overwritten
+			if (rows[x].shared())
+			{
+				rows[x] = make_row(first);
+				table[x] = rows[x].get();
+				return;
+			}
+			std::copy(first, last, table[x]);
+		}
+
+		template<class It>
+		void add_row(It first, It last)
+		{
+			if (std::distance(first, last) != cols)
+				throw std::out_of_range{ "columns count is not equal to new row" };
+
+			push_row(make_row(first));
+		}
+		template<class Container>
+		void add_row(const Container& cont) { add_row(std::cbegin(cont), std::cend(cont)); }
+
+		template<class MA = A>
+		matrix<T, MA> to_matrix() const
+		{
+			matrix<T, MA> result(count_rows(), cols);
+			for (Index i = 0; i < count_rows(); ++i)
+				std::copy(table[i], table[i] + cols, result.data()[i]);
+			return result;
+		}
+
+		void swap(cow_matrix& other)
+		{
+			std::swap(rows, other.rows);
+			std::swap(table, other.table);
+			std::swap(cols, other.cols);
+			std::swap(alloc, other.alloc);
+		}
+
+	private:
+		using elem_traits = std::allocator_traits<allocator_type>;
+
+		// Elements of a row with their own reference count. Owners release the row with
+		// acq_rel and shared() loads the count with acquire, so everything another copy did
+		// with the row before dropping it happens before a write by the remaining owner
+		// (std::shared_ptr::use_count is a relaxed load and gives no such ordering).
+		struct row_block
+		{
+			std::atomic<std::size_t> refs{ 1 };
+			allocator_type alloc;
+			T* elems{};
+			Index size{};
+
+			row_block(const allocator_type& al, T* p, Index n) : alloc{ al }, elems{ p }, size{ n } {}
+		};
+
+		using block_allocator = typename elem_traits::template rebind_alloc<row_block>;
+		using block_traits = std::allocator_traits<block_allocator>;
+
+		class row_ref
+		{
+		public:
+			row_ref() {}
+			explicit row_ref(row_block* b) : block{ b } {}
+			row_ref(const row_ref& other) noexcept : block{ other.block }
+			{
+				if (block != nullptr)
+					block->refs.fetch_add(1, std::memory_order_relaxed);
+			}
+			row_ref(row_ref&& other) noexcept : block{ other.block } { other.block = nullptr; }
+			row_ref& operator=(row_ref other) noexcept
+			{
+				std::swap(block, other.block);
+				return *this;
+			}
+			~row_ref() { release(); }
+
+			T* get() const { return block != nullptr ? block->elems : nullptr; }
+			bool shared() const { return block != nullptr && block->refs.load(std::memory_order_acquire) > 1; }
+
+		private:
+			void release() noexcept
+			{
+				if (block == nullptr) return;
+				if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					allocator_type al = block->alloc;
+					block_allocator bal{ al };
+					for (Index i = 0; i < block->size; ++i)
+						elem_traits::destroy(al, block->elems + i);
+					elem_traits::deallocate(al, block->elems, block->size);
+					block_traits::destroy(bal, block);
+					block_traits::deallocate(bal, block, 1);
+				}
+				block = nullptr;
+			}
+
+			row_block* block{};
+		};
+
+		template<class Init>
+		row_ref make_row_with(Init init)
+		{
+			if (cols == 0) return {};
+
+			T* p = elem_traits::allocate(alloc, cols);
+			Index i = 0;
+			try {
+				for (; i < cols; ++i)
+					init(p + i, i);
+
+				block_allocator bal{ alloc };
+				row_block* b = block_traits::allocate(bal, 1);
+				block_traits::construct(bal, b, alloc, p, cols);
+				return row_ref(b);
+			}
+			catch (...) {
+				for (Index k = 0; k < i; ++k)
+					elem_traits::destroy(alloc, p + k);
+				elem_traits::deallocate(alloc, p, cols);
+				throw;
+			}
+		}
+
+		template<class It>
+		row_ref make_row(It first)
+		{
+			return make_row_with([&](T* p, Index) { elem_traits::construct(alloc, p, *first); ++first; });
+		}
+		row_ref make_filled_row(const T& val)
+		{
+			return make_row_with([&](T* p, Index) { elem_traits::construct(alloc, p, val); });
+		}
+
+		void push_row(row_ref r)
+		{
+			table.push_back(r.get());
+			try {
+				rows.push_back(std::move(r));
+			}
+			catch (...) {
+				table.pop_back();
+				throw;
+			}
+		}
+
+		void unshare(Index x)
+		{
+			if (!rows[x].shared()) return;
+
+			rows[x] = make_row(static_cast<const T*>(table[x]));
+			table[x] = rows[x].get();
+		}
+
+		void range_check(Index x, Index n) const
+		{
+			if (x < 0 || x >= n)
+				throw std::out_of_range{ "index is out of range of cow_matrix" };
+		}
+
+		std::vector<row_ref> rows;
+		std::vector<T*> table;
+		Index cols{};
+		allocator_type alloc;
+	};
+}
+
+#endif // COW_MATRIX_HPP
@@ -0,0 +1,396 @@
+#pragma once
+#ifndef FACTORIZATION_HPP
+#define FACTORIZATION_HPP
+
+#include<cmath>
+#include<string>
+#include<vector>
+#include<utility>
+#include<stdexcept>
+#include<algorithm>
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Backend.hpp"
+#include"Gemv.hpp"
+
+namespace my
+{
+	// P * A = L * U with partial pivoting. L (unit diagonal, not stored) and U share the
+	// square matrix lu; row i of P * A is row perm[i] of A.
+	template<class T, class A = std::allocator<T>>
+	struct lu_factorization
+	{
+		matrix<T, A> lu;
+		std::vector<Index> perm;
+	};
+
+	// A = transpose(U) * U, where U is upper triangular with a positive diagonal. The
+	// upper factor is kept so that factorization, solves and updates all run along rows.
+	// Entries below the diagonal of u are zero.
+	template<class T, class A = std::allocator<T>>
+	struct cholesky_factorization
+	{
+		matrix<T, A> u;
+	};
+
+	namespace detail
+	{
+		template<class T, class A>
+		void check_square(const matrix<T, A>& a, const char* what)
+		{
+			if (a.count_rows() != a.count_cols())
+				throw std::invalid_argument{ std::string(what) + " requires a square matrix" };
+		}
+
+		inline void check_vector_size(Index size, Index n)
+		{
+			if (size != n)
+				throw std::invalid_argument{ "vector size does not match matrix size" };
+		}
+
+		// In place of b: L * y = P * b, then U * x = y.
+		template<class T, class A>
+		void lu_solve_in_place(const lu_factorization<T, A>& f, T* b)
+		{
+			const Index n = f.lu.count_rows();
+			const T* const* r = f.lu.data();
+			std::vector<T> y(n);
+			for (Index i = 0; i < n; ++i)
+				y[i] = b[f.perm[i]] - dot(r[i], y.data(), i);
+			for (Index i = n - 1; i >= 0; --i)
+				b[i] = (y[i] - dot(r[i] + i + 1, b + i + 1, n - 1 - i)) / r[i][i];
+		}
+	}
+
+	// LU factorization with partial pivoting, O(n^3). Rows below the pivot are eliminated
+	// in parallel. Throws std::domain_error if A is singular.
+	template<class T, class A>
+	lu_factorization<T, A> lu_factorize(const matrix<T, A>& a)
+	{
+		detail::check_square(a, "lu_factorize");
+		const Index n = a.count_rows();
+
+		lu_factorization<T, A> f{ a, std::vector<Index>(n) };
+		for (Index i = 0; i < n; ++i)
+			f.perm[i] = i;
+
+		T* const* r = f.lu.data();
+		for (Index k = 0; k < n; ++k)
+		{
+			Index p = k;
+			for (Index i = k + 1; i < n; ++i)
+				if (std::abs(r[i][k]) > std::abs(r[p][k]))
+					p = i;
+			if (r[p][k] == T{})
+				throw std::domain_error{ "matrix is singular" };
+			if (p != k)
+			{
+				f.lu.swap_rows(p, k);
+				std::swap(f.perm[p], f.perm[k]);
+			}
+
+			const T* pivot_row = r[k];
+			parallel_for(k + 1, n, detail::blas_row_grain(n - k), [&](Index first, Index last) {
+				for (Index i = first; i < last; ++i)
+				{
+					const T l = r[i][k] /= pivot_row[k];
+					detail::axpy(-l, pivot_row + k + 1, r[i] + k + 1, n - k - 1);
+				}
+			});
+		}
+		return f;
+	}
+
+	// Solution x of A * x = b.
+	template<class T, class A>
+	std::vector<T> lu_solve(const lu_factorization<T, A>& f, detail::non_deduced_t<vector_view<const T>> b)
+	{
+		detail::check_vector_size(b.size(), f.lu.count_rows());
+		std::vector<T> x(b.data(), b.data() + b.size());
+		detail::lu_solve_in_place(f, x.data());
+		return x;
+	}
+
+	// Solution X of A * X = B, column by column of B.
+	template<class T, class A>
+	matrix<T, A> lu_solve(const lu_factorization<T, A>& f, const matrix<T, A>& b)
+	{
+		const Index n = f.lu.count_rows();
+		if (b.count_rows() != n)
+			throw std::invalid_argument{ "rows count of right-hand side is not equal to matrix size" };
+
+		matrix<T, A> x(n, b.count_cols());
+		parallel_for(0, b.count_cols(), detail::blas_row_grain(n * n), [&](Index first, Index last) {
+			std::vector<T> col(n);
+			for (Index j = first; j < last; ++j)
+			{
+				for (Index i = 0; i < n; ++i)
+					col[i] = b.data()[i][j];
+				detail::lu_solve_in_place(f, col.data());
+				for (Index i = 0; i < n; ++i)
+					x.data()[i][j] = col[i];
+			}
+		});
+		return x;
+	}
+
+	// Inverse of A by LU factorization, O(n^3). Throws std::domain_error if A is singular.
+	template<class T, class A>
+	matrix<T, A> inverse(const matrix<T, A>& a)
+	{
+		const auto f = lu_factorize(a);
+		matrix<T, A> id(a.count_rows(), a.count_rows(), T{});
+		for (Index i = 0; i < a.count_rows(); ++i)
+			id.data()[i][i] = T{ 1 };
+		return lu_solve(f, id);
+	}
+
+	// Rank-1 update of the factorization to that of A + x * transpose(y), O(n^2), keeping
+	// the row permutation (Bennett's algorithm). Without re-pivoting this is only as
+	// stable as the pivots it produces: a zero pivot throws std::domain_error and leaves
+	// f unchanged, after which the matrix has to be factorized again.
+	template<class T, class A>
+	void lu_update(lu_factorization<T, A>& f, detail::non_deduced_t<vector_view<const T>> x,
+		detail::non_deduced_t<vector_view<const T>> y)
+	{
+		const Index n = f.lu.count_rows();
+		detail::check_vector_size(x.size(), n);
+		detail::check_vector_size(y.size(), n);
+
+		std::vector<T> px(n);
+		for (Index i = 0; i < n; ++i)
+			px[i] = x[f.perm[i]];
+		std::vector<T> py(y.data(), y.data() + n);
+
+		matrix<T, A> lu = f.lu;
+		T* const* r = lu.data();
+		for (Index k = 0; k < n; ++k)
+		{
+			const T u_kk = r[k][k];
+			const T x_k = px[k];
+			const T y_k = py[k];
+			const T d = u_kk + x_k * y_k;
+			if (d == T{})
+				throw std::domain_error{ "updated matrix is singular or needs pivoting" };
+
+			// U(k, k..) += x_k * y(k..), and y(k+1..) = (u_kk * y - y_k * U(k, k+1..)) / d
+			// with the old row of U
+			T* u_row = r[k];
+			for (Index j = k + 1; j < n; ++j)
+			{
+				const T u = u_row[j];
+				u_row[j] = u + x_k * py[j];
+				py[j] = (u_kk * py[j] - y_k * u) / d;
+			}
+			u_row[k] = d;
+
+			// L(k+1.., k) = (L * u_kk + x * y_k) / d and x(k+1..) -= x_k * L with the old L
+			for (Index i = k + 1; i < n; ++i)
+			{
+				const T l = r[i][k];
+				r[i][k] = (l * u_kk + px[i] * y_k) / d;
+				px[i] -= x_k * l;
+			}
+		}
+		f.lu.swap(lu);
+	}
+
+	// Cholesky factorization of a symmetric positive definite matrix, O(n^3); only the
+	// upper triangle of A is read. Rows below the pivot are updated in parallel. Throws
+	// std::domain_error if A is not positive definite.
+	template<class T, class A>
+	cholesky_factorization<T, A> cholesky_factorize(const matrix<T, A>& a)
+	{
+		detail::check_square(a, "cholesky_factorize");
+		const Index n = a.count_rows();
+
+		cholesky_factorization<T, A> f{ matrix<T, A>(n, n, T{}) };
+		T* const* u = f.u.data();
+		for (Index i = 0; i < n; ++i)
+			std::copy(a.data()[i] + i, a.data()[i] + n, u[i] + i);
+
+		for (Index k = 0; k < n; ++k)
+		{
+			if (!(u[k][k] > T{}))
+				throw std::domain_error{ "matrix is not positive definite" };
+			const T d = std::sqrt(u[k][k]);
+			u[k][k] = d;
+			for (Index j = k + 1; j < n; ++j)
+				u[k][j] /= d;
+
+			const T* pivot_row = u[k];
+			parallel_for(k + 1, n, detail::blas_row_grain(n - k), [&](Index first, Index last) {
+				for (Index i = first; i < last; ++i)
+					detail::axpy(-pivot_row[i], pivot_row + i, u[i] + i, n - i);
+			});
+		}
+		return f;
+	}
+
+	// Solution x of A * x = b: transpose(U) * y = b, then U * x = y.
+	template<class T, class A>
+	std::vector<T> cholesky_solve(const cholesky_factorization<T, A>& f, detail::non_deduced_t<vector_view<const T>> b)
+	{
+		const Index n = f.u.count_rows();
+		detail::check_vector_size(b.size(), n);
+
+		const T* const* u = f.u.data();
+		std::vector<T> x(b.data(), b.data() + n);
+		for (Index k = 0; k < n; ++k)
+		{
+			x[k] /= u[k][k];
+			detail::axpy(-x[k], u[k] + k + 1, x.data() + k + 1, n - k - 1);
+		}
+		for (Index i = n - 1; i >= 0; --i)
+			x[i] = (x[i] - detail::dot(u[i] + i + 1, x.data() + i + 1, n - 1 - i)) / u[i][i];
+		return x;
+	}
+
+	namespace detail
+	{
+		// Hyperbolic (sign = -1) or ordinary (sign = 1) rotations of the rows of U against
+		// x, O(n^2) along rows of U. Works on a copy, so that f is unchanged on failure.
+		template<class T, class A>
+		void cholesky_rank1(cholesky_factorization<T, A>& f, vector_view<const T> x, T sign)
+		{
+			const Index n = f.u.count_rows();
+			check_vector_size(x.size(), n);
+
+			std::vector<T> w(x.data(), x.data() + n);
+			matrix<T, A> u = f.u;
+			for (Index k = 0; k < n; ++k)
+			{
+				T* row = u.data()[k];
+				const T r2 = row[k] * row[k] + sign * w[k] * w[k];
+				if (!(r2 > T{}))
+					throw std::domain_error{ "downdated matrix is not positive definite" };
+
+				const T r = std::sqrt(r2);
+				const T c = r / row[k];
+				const T s = w[k] / row[k];
+				row[k] = r;
+				for (Index j = k + 1; j < n; ++j)
+				{
+					row[j] = (row[j] + sign * s * w[j]) / c;
+					w[j] = c * w[j] - s * row[j];
+				}
+			}
+			f.u.swap(u);
+		}
+	}
+
+	// Updates the factorization to that of A + x * transpose(x), O(n^2).
+	template<class T, class A>
+	void cholesky_update(cholesky_factorization<T, A>& f, detail::non_deduced_t<vector_view<const T>> x)
+	{
+		detail::cholesky_rank1(f, x, T{ 1 });
+	}
+
+	// Updates the factorization to that of A - x * transpose(x), O(n^2). Throws
+	// std::domain_error and leaves f unchanged if the result is not positive definite.
+	template<class T, class A>
+	void cholesky_downdate(cholesky_factorization<T, A>& f, detail::non_deduced_t<vector_view<const T>> x)
+	{
+		detail::cholesky_rank1(f, x, T{ -1 });
+	}
+
+	namespace detail
+	{
+		// inv -= z * transpose(w) / denom, the common step of the Sherman-Morrison updates
+		// below: z = inv * u and w = transpose(inv) * v must not alias inv.
+		template<class T, class A>
+		void sherman_morrison_apply(matrix<T, A>& inv, const std::vector<T>& z, const std::vector<T>& w, T denom)
+		{
+			if (denom == T{} || !std::isfinite(denom))
+				throw std::domain_error{ "updated matrix is singular" };
+			ger(-T{ 1 } / denom, z, w, inv);
+		}
+	}
+
+	// Sherman-Morrison: replaces inv = inverse(A) by inverse(A + u * transpose(v)), O(n^2).
+	// Throws std::domain_error and leaves inv unchanged if the updated matrix is singular.
+	template<class T, class A>
+	void sherman_morrison_update(matrix<T, A>& inv, detail::non_deduced_t<vector_view<const T>> u,
+		detail::non_deduced_t<vector_view<const T>> v)
+	{
+		detail::check_square(inv, "sherman_morrison_update");
+		const Index n = inv.count_rows();
+		std::vector<T> z(n);
+		std::vector<T> w(n);
+		gemv(T{ 1 }, inv, u, T{}, z);
+		gemv_transposed(T{ 1 }, inv, v, T{}, w);
+		detail::sherman_morrison_apply(inv, z, w, T{ 1 } + detail::dot(v.data(), z.data(), n));
+	}
+
+	// inv = inverse(A) becomes the inverse of A with delta added to row i, e.g. after
+	// A.row(i) = new_row with delta = new_row - old_row.
+	template<class T, class A>
+	void inverse_update_row(matrix<T, A>& inv, Index i, detail::non_deduced_t<vector_view<const T>> delta)
+	{
+		detail::check_square(inv, "inverse_update_row");
+		const Index n = inv.count_rows();
+		if (i < 0 || i >= n)
+			throw std::out_of_range{ "index is out of range of matrix" };
+
+		// u = e_i: z is column i of inv
+		std::vector<T> z(n);
+		std::vector<T> w(n);
+		for (Index r = 0; r < n; ++r)
+			z[r] = inv.data()[r][i];
+		gemv_transposed(T{ 1 }, inv, delta, T{}, w);
+		detail::sherman_morrison_apply(inv, z, w, T{ 1 } + w[i]);
+	}
+
+	// inv = inverse(A) becomes the inverse of A with delta added to column j.
+	template<class T, class A>
+	void inverse_update_column(matrix<T, A>& inv, Index j, detail::non_deduced_t<vector_view<const T>> delta)
+	{
+		detail::check_square(inv, "inverse_update_column");
+		const Index n = inv.count_rows();
+		if (j < 0 || j >= n)
+			throw std::out_of_range{ "index is out of range of matrix" };
+
+		// v = e_j: w is row j of inv
+		std::vector<T> z(n);
+		gemv(T{ 1 }, inv, delta, T{}, z);
+		std::vector<T> w(inv.data()[j], inv.data()[j] + n);
+		detail::sherman_morrison_apply(inv, z, w, T{ 1 } + z[j]);
+	}
+
+	// Woodbury: replaces inv = inverse(A) by inverse(A + U * transpose(V)), where U and V
+	// are n x k, in O(n^2 * k + k^3) instead of O(n^3). Throws std::domain_error and leaves
+	// inv unchanged if the updated matrix is singular.
+	template<class T, class A>
+	void woodbury_update(matrix<T, A>& inv, const matrix<T, A>& u, const matrix<T, A>& v)
+	{
+		detail::check_square(inv, "woodbury_update");
+		const Index n = inv.count_rows();
+		const Index k = u.count_cols();
+		if (u.count_rows() != n || v.count_rows() != n || v.count_cols() != k)
+			throw std::invalid_argument{ "update factors have wrong size" };
+		if (k == 0) return;
+
+		// Z = inv * U, Y = transpose(V) * inv, S = I + transpose(V) * Z
+		matrix<T, A> z(n, k);
+		gemm(T{ 1 }, inv, u, T{}, z);
+
+		matrix<T, A> y(k, n, T{});
+		for (Index i = 0; i < n; ++i)
+			for (Index r = 0; r < k; ++r)
+				detail::axpy(v.data()[i][r], inv.data()[i], y.data()[r], n);
+
+		matrix<T, A> s(k, k, T{});
+		for (Index r = 0; r < k; ++r)
+		{
+			s.data()[r][r] = T{ 1 };
+			for (Index i = 0; i < n; ++i)
+				detail::axpy(v.data()[i][r], z.data()[i], s.data()[r], k);
+		}
+
+		const matrix<T, A> t = lu_solve(lu_factorize(s), y);
+		gemm(-T{ 1 }, z, t, T{ 1 }, inv);
+	}
+}
+
+#endif // FACTORIZATION_HPP
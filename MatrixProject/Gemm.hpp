@@ -0,0 +1,100 @@
+#pragma once
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include<cstddef>
+#include<stdexcept>
+#include<algorithm>
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+
+namespace my
+{
+	// Row accessors used by the kernels: rows(i) returns a pointer to the first element of
+	// the i-th row of a block. They let the same kernel run on the T** row table of a
+	// matrix and on contiguous workspace buffers.
+	template<class T>
+	struct table_rows
+	{
+		T* const* rows{};
+		Index col{};
+
+		T* operator()(Index i) const { return rows[i] + col; }
+	};
+
+	template<class T>
+	struct strided_rows
+	{
+		T* base{};
+		std::ptrdiff_t ld{};
+
+		T* operator()(Index i) const { return base + static_cast<std::ptrdiff_t>(i) * ld; }
+	};
+
+	// Tile sizes of the blocked kernel: a gemm_block_k x gemm_block_n panel of B stays in L2
+	// while gemm_block_m rows of A and C stream through it.
+	constexpr Index gemm_block_m = 64;
+	constexpr Index gemm_block_k = 128;
+	constexpr Index gemm_block_n = 256;
+
+	// Ordinary arithmetic as a semiring policy (see Semiring.hpp for the others): add and
+	// mul are the operations of the product, zero() is the identity of add. skip_zero
+	// tells the kernels whether a zero() left operand may be skipped; it is false here so
+	// that NaN and infinity propagate as in plain arithmetic.
+	template<class T>
+	struct plus_times
+	{
+		static constexpr bool skip_zero = false;
+
+		static constexpr T zero() { return T{}; }
+		static constexpr T one() { return T{ 1 }; }
+		static T add(T a, T b) { return a + b; }
+		static T mul(T a, T b) { return a * b; }
+	};
+
+	// Conventional cache-blocked product C = add(C, A * B) in the semiring S, where A is
+	// m x k, B is k x n and C is m x n, all addressed through row accessors. The innermost
+	// loop runs along a row of B and C so that it is vectorized by the compiler. Single
+	// threaded.
+	template<class S, class RowsA, class RowsB, class RowsC>
+	void semiring_accumulate(Index m, Index n, Index k, RowsA a, RowsB b, RowsC c)
+	{
+		for (Index jj = 0; jj < n; jj += gemm_block_n)
+		{
+			const Index j_end = std::min(jj + gemm_block_n, n);
+			for (Index pp = 0; pp < k; pp += gemm_block_k)
+			{
+				const Index p_end = std::min(pp + gemm_block_k, k);
+				for (Index ii = 0; ii < m; ii += gemm_block_m)
+				{
+					const Index i_end = std::min(ii + gemm_block_m, m);
+					for (Index i = ii; i < i_end; ++i)
+					{
+						const auto* a_row = a(i);
+						auto* c_row = c(i);
+						for (Index p = pp; p < p_end; ++p)
+						{
+							const auto a_ip = a_row[p];
+							if constexpr (S::skip_zero)
+								if (a_ip == S::zero()) continue;
+
+							const auto* b_row = b(p);
+							for (Index j = jj; j < j_end; ++j)
+								c_row[j] = S::add(c_row[j], S::mul(a_ip, b_row[j]));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// C += A * B, see semiring_accumulate.
+	template<class T, class RowsA, class RowsB, class RowsC>
+	void gemm_accumulate(Index m, Index n, Index k, RowsA a, RowsB b, RowsC c)
+	{
+		semiring_accumulate<plus_times<T>>(m, n, k, a, b, c);
+	}
+}
+
+#endif // GEMM_HPP
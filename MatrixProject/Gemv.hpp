@@ -0,0 +1,162 @@
+#pragma once
+#ifndef GEMV_HPP
+#define GEMV_HPP
+
+#include<vector>
+#include<stdexcept>
+#include<algorithm>
+#include<type_traits>
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Backend.hpp"
+
+namespace my
+{
+	// Non-owning view of a contiguous vector. Built implicitly from anything with data()
+	// and size() (std::vector, std::array, matrix::Row, ...) or from a pointer and a size,
+	// so that vector arguments below are never copied.
+	template<class T>
+	class vector_view
+	{
+	public:
+		vector_view() {}
+		vector_view(T* p, Index n) : ptr{ p }, n{ n } {}
+
+		template<class C, class = std::enable_if_t<
+			std::is_convertible_v<decltype(std::declval<C&>().data()), T*> &&
+			!std::is_same_v<std::decay_t<C>, vector_view>>>
+		vector_view(C&& c) : ptr{ c.data() }, n{ static_cast<Index>(c.size()) } {}
+
+		T* data() const { return ptr; }
+		Index size() const { return n; }
+		T& operator[](Index i) const { return ptr[i]; }
+
+	private:
+		T* ptr{};
+		Index n{};
+	};
+
+	namespace detail
+	{
+		// C(i, j) for j <= i from the lower triangle, mirrored to the upper one.
+		template<class T, class A>
+		void mirror_lower(matrix<T, A>& c)
+		{
+			T* const* rows = c.data();
+			parallel_for(0, c.count_rows(), blas_row_grain(c.count_rows()), [&](Index first, Index last) {
+				for (Index i = first; i < last; ++i)
+					for (Index j = i + 1; j < c.count_cols(); ++j)
+						rows[i][j] = rows[j][i];
+			});
+		}
+
+		// Rows t and n - 1 - t of a triangle together cost the same for every t, which
+		// balances the contiguous chunks of parallel_for.
+		template<class F>
+		void for_triangle_rows(Index n, Index cols, F f)
+		{
+			parallel_for(0, (n + 1) / 2, blas_row_grain(cols * 2), [&](Index first, Index last) {
+				for (Index t = first; t < last; ++t)
+				{
+					f(t);
+					if (n - 1 - t != t)
+						f(n - 1 - t);
+				}
+			});
+		}
+	}
+
+	// y = alpha * A * x + beta * y. Rows of A are processed in parallel for large sizes.
+	// x and y must not overlap. Always the builtin kernel on the row table of A (see
+	// Backend.hpp).
+	template<class T, class A>
+	void gemv(detail::non_deduced_t<T> alpha, const matrix<T, A>& a, detail::non_deduced_t<vector_view<const T>> x,
+		detail::non_deduced_t<T> beta, detail::non_deduced_t<vector_view<T>> y)
+	{
+		if (x.size() != a.count_cols() || y.size() != a.count_rows())
+			throw std::invalid_argument{ "vector size does not match matrix size" };
+
+		detail::builtin_gemv<T>(false, a.count_rows(), a.count_cols(), alpha, table_rows<const T>{ a.data(), 0 }, x.data(), beta, y.data());
+	}
+
+	// y = alpha * transpose(A) * x + beta * y, without forming the transpose.
+	template<class T, class A>
+	void gemv_transposed(detail::non_deduced_t<T> alpha, const matrix<T, A>& a, detail::non_deduced_t<vector_view<const T>> x,
+		detail::non_deduced_t<T> beta, detail::non_deduced_t<vector_view<T>> y)
+	{
+		if (x.size() != a.count_rows() || y.size() != a.count_cols())
+			throw std::invalid_argument{ "vector size does not match matrix size" };
+
+		detail::builtin_gemv<T>(true, a.count_rows(), a.count_cols(), alpha, table_rows<const T>{ a.data(), 0 }, x.data(), beta, y.data());
+	}
+
+	// Rank-1 update A += alpha * x * transpose(y).
+	template<class T, class A>
+	void ger(detail::non_deduced_t<T> alpha, detail::non_deduced_t<vector_view<const T>> x,
+		detail::non_deduced_t<vector_view<const T>> y, matrix<T, A>& a)
+	{
+		if (x.size() != a.count_rows() || y.size() != a.count_cols())
+			throw std::invalid_argument{ "vector size does not match matrix size" };
+
+		T* const* rows = a.data();
+		parallel_for(0, a.count_rows(), detail::blas_row_grain(a.count_cols()), [&](Index first, Index last) {
+			for (Index i = first; i < last; ++i)
+				detail::axpy(alpha * x[i], y.data(), rows[i], a.count_cols());
+		});
+	}
+
+	// Rank-k update C = alpha * A * transpose(A) + beta * C, C is count_rows(A) square.
+	// Only the lower triangle of C is read; the result is written to both triangles.
+	template<class T, class A>
+	void syrk(detail::non_deduced_t<T> alpha, const matrix<T, A>& a, detail::non_deduced_t<T> beta, matrix<T, A>& c)
+	{
+		const Index n = a.count_rows();
+		if (c.count_rows() != n || c.count_cols() != n)
+			throw std::invalid_argument{ "result matrix has wrong size" };
+
+		const T* const* ra = a.data();
+		T* const* rc = c.data();
+		detail::for_triangle_rows(n, a.count_cols() * (n / 2 + 1), [&](Index i) {
+			for (Index j = 0; j <= i; ++j)
+			{
+				const T d = alpha * detail::dot(ra[i], ra[j], a.count_cols());
+				rc[i][j] = (beta == T{}) ? d : d + beta * rc[i][j];
+			}
+		});
+		detail::mirror_lower(c);
+	}
+
+	// Rank-k update C = alpha * transpose(A) * A + beta * C, C is count_cols(A) square.
+	// Accumulated as a sum of rank-1 updates by the rows of A. Only the lower triangle of
+	// C is read; the result is written to both triangles.
+	template<class T, class A>
+	void syrk_transposed(detail::non_deduced_t<T> alpha, const matrix<T, A>& a, detail::non_deduced_t<T> beta, matrix<T, A>& c)
+	{
+		const Index n = a.count_cols();
+		if (c.count_rows() != n || c.count_cols() != n)
+			throw std::invalid_argument{ "result matrix has wrong size" };
+
+		const T* const* ra = a.data();
+		T* const* rc = c.data();
+		parallel_for(0, (n + 1) / 2, detail::blas_row_grain(a.count_rows() * (n / 2 + 1)), [&](Index first, Index last) {
+			// rows t and n - 1 - t for t in [first, last), see detail::for_triangle_rows
+			std::vector<Index> owned;
+			for (Index t = first; t < last; ++t)
+			{
+				owned.push_back(t);
+				if (n - 1 - t != t)
+					owned.push_back(n - 1 - t);
+			}
+
+			for (Index i : owned)
+				detail::scale(beta, rc[i], i + 1);
+			for (Index r = 0; r < a.count_rows(); ++r)
+				for (Index i : owned)
+					detail::axpy(alpha * ra[r][i], ra[r], rc[i], i + 1);
+		});
+		detail::mirror_lower(c);
+	}
+}
+
+#endif // GEMV_HPP
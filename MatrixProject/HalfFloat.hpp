@@ -0,0 +1,445 @@
+#pragma once
+#ifndef HALF_FLOAT_HPP
+#define HALF_FLOAT_HPP
+
+#include<cmath>
+#include<cstdint>
+#include<cstring>
+#include<vector>
+#include<ostream>
+#include<stdexcept>
+#include<algorithm>
+#include<type_traits>
+
+#if defined(__F16C__) || (defined(__AVX512BF16__) && defined(__AVX512F__))
+#include<immintrin.h>
+#endif
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Gemm.hpp"
+#include"Reductions.hpp"
+
+namespace my
+{
+	namespace detail
+	{
+		inline std::uint32_t float_bits(float f)
+		{
+			std::uint32_t u;
+			std::memcpy(&u, &f, sizeof(u));
+			return u;
+		}
+		inline float bits_float(std::uint32_t u)
+		{
+			float f;
+			std::memcpy(&f, &u, sizeof(f));
+			return f;
+		}
+
+		// IEEE 754 binary16: 1 sign, 5 exponent, 10 mantissa bits; round to nearest even,
+		// subnormals supported.
+		struct ieee_half_format
+		{
+			static std::uint16_t from_float(float f)
+			{
+#if defined(__F16C__)
+				return static_cast<std::uint16_t>(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+				const std::uint32_t x = float_bits(f);
+				const std::uint32_t sign = (x >> 16) & 0x8000u;
+				std::uint32_t mant = x & 0x7fffffu;
+				const std::int32_t exp = static_cast<std::int32_t>((x >> 23) & 0xffu);
+
+				if (exp == 0xff)
+					return static_cast<std::uint16_t>(sign | 0x7c00u | (mant ? 0x200u | (mant >> 13) : 0u));
+
+				const std::int32_t e = exp - 127 + 15;
+				if (e >= 0x1f)
+					return static_cast<std::uint16_t>(sign | 0x7c00u);
+
+				if (e <= 0)
+				{
+					if (e < -10)
+						return static_cast<std::uint16_t>(sign);
+
+					mant |= 0x800000u;
+					const std::uint32_t shift = static_cast<std::uint32_t>(14 - e);
+					std::uint32_t h = mant >> shift;
+					const std::uint32_t rem = mant & ((1u << shift) - 1u);
+					const std::uint32_t halfway = 1u << (shift - 1u);
+					if (rem > halfway || (rem == halfway && (h & 1u)))
+						++h;
+					return static_cast<std::uint16_t>(sign | h);
+				}
+
+				// a carry out of the mantissa correctly rounds up the exponent (up to infinity)
+				std::uint32_t h = sign | (static_cast<std::uint32_t>(e) << 10) | (mant >> 13);
+				const std::uint32_t rem = mant & 0x1fffu;
+				if (rem > 0x1000u || (rem == 0x1000u && (h & 1u)))
+					++h;
+				return static_cast<std::uint16_t>(h);
+#endif
+			}
+
+			static float to_float(std::uint16_t h)
+			{
+#if defined(__F16C__)
+				return _cvtsh_ss(h);
+#else
+				const std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000u) << 16;
+				const std::uint32_t exp = (h >> 10) & 0x1fu;
+				std::uint32_t mant = h & 0x3ffu;
+
+				if (exp == 0)
+				{
+					if (mant == 0)
+						return bits_float(sign);
+
+					std::int32_t e = 1;
+					while (!(mant & 0x400u))
+					{
+						mant <<= 1;
+						--e;
+					}
+					mant &= 0x3ffu;
+					return bits_float(sign | (static_cast<std::uint32_t>(e + 112) << 23) | (mant << 13));
+				}
+				if (exp == 0x1f)
+					return bits_float(sign | 0x7f800000u | (mant << 13));
+
+				return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+#endif
+			}
+		};
+
+		// bfloat16: the upper half of a binary32, round to nearest even; NaNs stay quiet NaNs.
+		struct bfloat16_format
+		{
+			static std::uint16_t from_float(float f)
+			{
+				const std::uint32_t x = float_bits(f);
+				const bool nan = (x & 0x7fffffffu) > 0x7f800000u;
+				const std::uint32_t rounded = (x + 0x7fffu + ((x >> 16) & 1u)) >> 16;
+				return static_cast<std::uint16_t>(nan ? ((x >> 16) | 0x40u) : rounded);
+			}
+
+			static float to_float(std::uint16_t h) { return bits_float(static_cast<std::uint32_t>(h) << 16); }
+		};
+	}
+
+	// 16-bit floating point storage type. Arithmetic is done in float: values convert
+	// implicitly to float and back, so basic_float16 can be used as T of matrix<T, A> and
+	// with ordinary expressions, while bulk conversion and the mixed precision kernels
+	// below avoid the per-element conversions on hot paths.
+	template<class Format>
+	class basic_float16
+	{
+	public:
+		using format = Format;
+
+		constexpr basic_float16() noexcept = default;
+		template<class U, typename = std::enable_if_t<std::is_arithmetic_v<U>>>
+		basic_float16(U value) noexcept : bits_{ Format::from_float(static_cast<float>(value)) } {}
+
+		static basic_float16 from_bits(std::uint16_t bits) noexcept
+		{
+			basic_float16 r;
+			r.bits_ = bits;
+			return r;
+		}
+		std::uint16_t bits() const noexcept { return bits_; }
+
+		operator float() const noexcept { return Format::to_float(bits_); }
+
+		basic_float16 operator-() const noexcept { return from_bits(static_cast<std::uint16_t>(bits_ ^ 0x8000u)); }
+
+		basic_float16& operator+=(float x) noexcept { return *this = static_cast<float>(*this) + x; }
+		basic_float16& operator-=(float x) noexcept { return *this = static_cast<float>(*this) - x; }
+		basic_float16& operator*=(float x) noexcept { return *this = static_cast<float>(*this) * x; }
+		basic_float16& operator/=(float x) noexcept { return *this = static_cast<float>(*this) / x; }
+
+		friend std::ostream& operator<<(std::ostream& os, const basic_float16& h)
+		{
+			return os << static_cast<float>(h);
+		}
+
+	private:
+		std::uint16_t bits_{};
+	};
+
+	using half = basic_float16<detail::ieee_half_format>;
+	using bfloat16 = basic_float16<detail::bfloat16_format>;
+
+	static_assert(sizeof(half) == 2 && std::is_trivially_copyable_v<half>, "half must be a plain 16-bit value");
+	static_assert(sizeof(bfloat16) == 2 && std::is_trivially_copyable_v<bfloat16>, "bfloat16 must be a plain 16-bit value");
+
+	// ---------------- bulk conversion ----------------
+
+	inline void convert(const float* src, Index n, half* dst)
+	{
+		Index i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+		for (; i + 8 <= n; i += 8)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+		for (; i < n; ++i)
+			dst[i] = half(src[i]);
+	}
+
+	inline void convert(const half* src, Index n, float* dst)
+	{
+		Index i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+		for (; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+#endif
+		for (; i < n; ++i)
+			dst[i] = static_cast<float>(src[i]);
+	}
+
+	// On AVX-512 BF16 hardware (vcvtneps2bf16) subnormal floats are flushed to zero,
+	// the portable path keeps them.
+	inline void convert(const float* src, Index n, bfloat16* dst)
+	{
+		Index i = 0;
+#if defined(__AVX512BF16__) && defined(__AVX512F__)
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m256bh packed = _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i));
+			std::memcpy(static_cast<void*>(dst + i), &packed, sizeof(packed));
+		}
+#endif
+		std::uint16_t* out = reinterpret_cast<std::uint16_t*>(dst);
+		for (; i < n; ++i)
+			out[i] = detail::bfloat16_format::from_float(src[i]);
+	}
+
+	inline void convert(const bfloat16* src, Index n, float* dst)
+	{
+		const std::uint16_t* in = reinterpret_cast<const std::uint16_t*>(src);
+		for (Index i = 0; i < n; ++i)
+			dst[i] = detail::bits_float(static_cast<std::uint32_t>(in[i]) << 16);
+	}
+
+	// Element type conversion of a whole matrix, using the bulk conversions above when
+	// converting between float and a 16-bit type.
+	template<class U, class T, class A>
+	matrix<U, typename std::allocator_traits<A>::template rebind_alloc<U>> matrix_cast(const matrix<T, A>& mtx)
+	{
+		matrix<U, typename std::allocator_traits<A>::template rebind_alloc<U>> result(mtx.count_rows(), mtx.count_cols());
+		for (Index i = 0; i < mtx.count_rows(); ++i)
+		{
+			const T* src = mtx.data()[i];
+			U* dst = result.data()[i];
+			if constexpr (std::is_same_v<T, float> && (std::is_same_v<U, half> || std::is_same_v<U, bfloat16>))
+				convert(src, mtx.count_cols(), dst);
+			else if constexpr (std::is_same_v<U, float> && (std::is_same_v<T, half> || std::is_same_v<T, bfloat16>))
+				convert(src, mtx.count_cols(), dst);
+			else
+				std::transform(src, src + mtx.count_cols(), dst, [](const T& x) { return static_cast<U>(x); });
+		}
+		return result;
+	}
+
+	// ---------------- mixed precision kernels ----------------
+
+	namespace detail
+	{
+		// elements converted at a time by the elementwise kernels
+		constexpr Index float16_chunk = 256;
+
+		// f(float_row, i) for every row of a 16-bit matrix, rows converted to float first.
+		template<class F, class A, class Fn>
+		void for_each_float_row(const matrix<basic_float16<F>, A>& mtx, Fn fn)
+		{
+			std::vector<float> buf(mtx.count_cols());
+			for (Index i = 0; i < mtx.count_rows(); ++i)
+			{
+				convert(mtx.data()[i], mtx.count_cols(), buf.data());
+				fn(buf.data(), i);
+			}
+		}
+	}
+
+	// result[i][j] = f(a[i][j]) computed in float, stored as 16-bit.
+	template<class F, class A, class Fn>
+	matrix<basic_float16<F>, A> elementwise(const matrix<basic_float16<F>, A>& a, Fn f)
+	{
+		using H = basic_float16<F>;
+		matrix<H, A> result(a.count_rows(), a.count_cols());
+		parallel_for(0, a.count_rows(), 16, [&](Index first, Index last) {
+			float x[detail::float16_chunk];
+			for (Index i = first; i < last; ++i)
+			{
+				for (Index j = 0; j < a.count_cols(); j += detail::float16_chunk)
+				{
+					const Index n = std::min(detail::float16_chunk, a.count_cols() - j);
+					convert(a.data()[i] + j, n, x);
+					for (Index k = 0; k < n; ++k)
+						x[k] = f(x[k]);
+					convert(x, n, result.data()[i] + j);
+				}
+			}
+		});
+		return result;
+	}
+
+	// result[i][j] = f(a[i][j], b[i][j]) computed in float, stored as 16-bit.
+	template<class F, class A, class Fn>
+	matrix<basic_float16<F>, A> elementwise(const matrix<basic_float16<F>, A>& a, const matrix<basic_float16<F>, A>& b, Fn f)
+	{
+		if (a.count_rows() != b.count_rows() || a.count_cols() != b.count_cols())
+			throw std::invalid_argument{ "matrices should be equal by size" };
+
+		using H = basic_float16<F>;
+		matrix<H, A> result(a.count_rows(), a.count_cols());
+		parallel_for(0, a.count_rows(), 16, [&](Index first, Index last) {
+			float x[detail::float16_chunk];
+			float y[detail::float16_chunk];
+			for (Index i = first; i < last; ++i)
+			{
+				for (Index j = 0; j < a.count_cols(); j += detail::float16_chunk)
+				{
+					const Index n = std::min(detail::float16_chunk, a.count_cols() - j);
+					convert(a.data()[i] + j, n, x);
+					convert(b.data()[i] + j, n, y);
+					for (Index k = 0; k < n; ++k)
+						x[k] = f(x[k], y[k]);
+					convert(x, n, result.data()[i] + j);
+				}
+			}
+		});
+		return result;
+	}
+
+	// Product of two 16-bit matrices accumulated and returned in float. Panels of A and B
+	// are converted to float once per cache block and fed to the blocked float kernel.
+	template<class F, class A>
+	matrix<float> mixed_multiply(const matrix<basic_float16<F>, A>& a, const matrix<basic_float16<F>, A>& b)
+	{
+		if (a.count_cols() != b.count_rows())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+
+		const Index m = a.count_rows();
+		const Index n = b.count_cols();
+		const Index k = a.count_cols();
+
+		matrix<float> result(m, n, 0.0f);
+		float* const* c = result.data();
+
+		parallel_for(0, m, gemm_block_m, [&](Index first, Index last) {
+			std::vector<float> b_panel(static_cast<std::size_t>(gemm_block_k) * gemm_block_n);
+			std::vector<float> a_panel(static_cast<std::size_t>(gemm_block_m) * gemm_block_k);
+
+			for (Index jj = 0; jj < n; jj += gemm_block_n)
+			{
+				const Index nb = std::min(gemm_block_n, n - jj);
+				for (Index pp = 0; pp < k; pp += gemm_block_k)
+				{
+					const Index kb = std::min(gemm_block_k, k - pp);
+					for (Index p = 0; p < kb; ++p)
+						convert(b.data()[pp + p] + jj, nb, b_panel.data() + static_cast<std::size_t>(p) * gemm_block_n);
+
+					for (Index ii = first; ii < last; ii += gemm_block_m)
+					{
+						const Index mb = std::min(gemm_block_m, last - ii);
+						for (Index i = 0; i < mb; ++i)
+							convert(a.data()[ii + i] + pp, kb, a_panel.data() + static_cast<std::size_t>(i) * gemm_block_k);
+
+						gemm_accumulate<float>(mb, nb, kb,
+							strided_rows<const float>{ a_panel.data(), gemm_block_k },
+							strided_rows<const float>{ b_panel.data(), gemm_block_n },
+							table_rows<float>{ c + ii, jj });
+					}
+				}
+			}
+		});
+
+		return result;
+	}
+
+	// Reductions of 16-bit matrices: rows are converted to float and reduced in float,
+	// results are float.
+	template<class F, class A>
+	float sum(const matrix<basic_float16<F>, A>& mtx, summation s = summation::naive)
+	{
+		std::vector<float> partial(mtx.count_rows());
+		detail::for_each_float_row(mtx, [&](const float* r, Index i) {
+			partial[i] = detail::sum_span(r, mtx.count_cols(), s, detail::identity_op{});
+		});
+		return detail::sum_span(partial.data(), static_cast<Index>(partial.size()), s, detail::identity_op{});
+	}
+
+	template<class F, class A>
+	float mean(const matrix<basic_float16<F>, A>& mtx, summation s = summation::naive)
+	{
+		detail::empty_check(detail::element_count(mtx));
+		return sum(mtx, s) / static_cast<float>(detail::element_count(mtx));
+	}
+
+	template<class F, class A>
+	std::vector<float> row_sums(const matrix<basic_float16<F>, A>& mtx, summation s = summation::naive)
+	{
+		std::vector<float> result(mtx.count_rows());
+		detail::for_each_float_row(mtx, [&](const float* r, Index i) {
+			result[i] = detail::sum_span(r, mtx.count_cols(), s, detail::identity_op{});
+		});
+		return result;
+	}
+
+	template<class F, class A>
+	std::vector<float> col_sums(const matrix<basic_float16<F>, A>& mtx, summation s = summation::naive)
+	{
+		std::vector<float> result(mtx.count_cols());
+		std::vector<float> comp(mtx.count_cols());
+		detail::for_each_float_row(mtx, [&](const float* r, Index) {
+			for (Index j = 0; j < mtx.count_cols(); ++j)
+			{
+				if (s == summation::kahan)
+					detail::kahan_add(result[j], comp[j], r[j]);
+				else
+					result[j] += r[j];
+			}
+		});
+		return result;
+	}
+
+	// l2 (spectral) norm is not available for 16-bit matrices; use matrix_cast<float> first.
+	template<class F, class A>
+	float norm(const matrix<basic_float16<F>, A>& mtx, norm_type type = norm_type::frobenius, summation s = summation::naive)
+	{
+		switch (type)
+		{
+		case norm_type::l1:
+		{
+			std::vector<float> cols(mtx.count_cols());
+			detail::for_each_float_row(mtx, [&](const float* r, Index) {
+				for (Index j = 0; j < mtx.count_cols(); ++j)
+					cols[j] += std::abs(r[j]);
+			});
+			return cols.empty() ? 0.0f : *std::max_element(cols.begin(), cols.end());
+		}
+		case norm_type::infinity:
+		{
+			float best = 0.0f;
+			detail::for_each_float_row(mtx, [&](const float* r, Index) {
+				best = std::max(best, detail::sum_span(r, mtx.count_cols(), s, detail::abs_op{}));
+			});
+			return best;
+		}
+		case norm_type::frobenius:
+		{
+			std::vector<float> partial(mtx.count_rows());
+			detail::for_each_float_row(mtx, [&](const float* r, Index i) {
+				partial[i] = detail::sum_span(r, mtx.count_cols(), s, detail::square_op{});
+			});
+			return std::sqrt(detail::sum_span(partial.data(), static_cast<Index>(partial.size()), s, detail::identity_op{}));
+		}
+		default:
+			throw std::invalid_argument{ "spectral norm of a 16-bit matrix is not supported, convert it to float first" };
+		}
+	}
+}
+
+#endif // HALF_FLOAT_HPP
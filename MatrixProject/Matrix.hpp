@@ -10,6 +10,10 @@
 #include<algorithm>
 #include<iterator>
 #include<vector>
+#include<cstddef>
+#include<cstdint>
+#include<utility>
+#include<ostream>
 
 namespace my
 {
@@ -24,7 +28,27 @@ namespace my
 		return current;
 	}
 
-	using Index = int;
+	// Type of sizes, indices and iterator differences. 64-bit by default, so that a single
+	// matrix may exceed 2^31 rows, columns or elements. Define MY_MATRIX_INDEX_32 to get a
+	// 32-bit Index, which halves index arrays (indexed_value, extremum, ...) but limits
+	// every size to 2^31 - 1.
+#if defined(MY_MATRIX_INDEX_32)
+	using Index = std::int32_t;
+#else
+	using Index = std::ptrdiff_t;
+#endif
+	static_assert(std::is_signed_v<Index>, "Index must be a signed integer type");
+
+	namespace detail
+	{
+		// operator-> of iterators whose operator* returns a proxy by value
+		template<class R>
+		struct arrow_proxy
+		{
+			R r;
+			R* operator->() { return &r; }
+		};
+	}
 
 	template<class T, class A>
 	struct MatrixBase
@@ -44,9 +68,23 @@ namespace my
 			if (r == 0) return;
 			elem = alloc.allocate(r);
 
-			if (c == 0) return;
-			for (Index i = 0; i < r; ++i)
-				elem[i] = (alloc.inner_allocator()).allocate(c);
+			if (c == 0)
+			{
+				std::fill(elem, elem + r, nullptr);
+				return;
+			}
+
+			Index i = 0;
+			try {
+				for (; i < r; ++i)
+					elem[i] = (alloc.inner_allocator()).allocate(c);
+			}
+			catch (...) {
+				for (Index k = 0; k < i; ++k)
+					(alloc.inner_allocator()).deallocate(elem[k], c);
+				alloc.deallocate(elem, r);
+				throw;
+			}
 		}
 
 		~MatrixBase() 
@@ -57,7 +95,8 @@ namespace my
 					(alloc.inner_allocator()).deallocate(elem[i], space.col);
 			}
 
-			alloc.deallocate(elem, space.row);
+			if (elem != nullptr)
+				alloc.deallocate(elem, space.row);
 		}
 
 		allocator_type get_allocator() { return alloc.inner_allocator(); }
@@ -71,6 +110,15 @@ namespace my
 		}
 
 	protected:
+		using elem_traits = std::allocator_traits<allocator_type>;
+
+		template<class... Args>
+		void construct_elem(T* p, Args&&... args)
+		{
+			elem_traits::construct(this->alloc.inner_allocator(), p, std::forward<Args>(args)...);
+		}
+		void destroy_elem(T* p) { elem_traits::destroy(this->alloc.inner_allocator(), p); }
+
 		struct RowDeleter
 		{
 			explicit RowDeleter(const allocator_type& allocator_, Index size_) : size_{ size_ }, alloc_{ allocator_ }{}
@@ -116,13 +164,14 @@ namespace my
 			if (this->elem[r] == nullptr) return;
 			for (Index i = 0; i < this->sz.col; ++i)
 			{
-				(this->alloc.inner_allocator()).destroy(&this->elem[r][i]);
+				this->destroy_elem(&this->elem[r][i]);
 			}
 
 			(this->alloc.inner_allocator()).deallocate(this->elem[r], this->space.col);
 		}
 		void delete_matrix()
 		{
+			if (this->elem == nullptr) return;
 			this->alloc.deallocate(this->elem, this->space.row);
 		}
 
@@ -148,15 +197,19 @@ namespace my
 
 		class MatrixIterator;
 		class ConstMatrixIterator;
+		template<class U> class BasicElementIterator;
+		template<class It> class ElementRange;
 
 		using allocator_type = A;
 		using size_type = Index;
 		using value_type = T;
 		using iterator = MatrixIterator;
 		using const_iterator = ConstMatrixIterator;
+		using element_iterator = BasicElementIterator<T>;
+		using const_element_iterator = BasicElementIterator<const T>;
 
 		matrix() : MBase() {}
-		explicit matrix(size_type dim, const allocator_type& al = allocator_type()) : MBase(al, dim)
+		explicit matrix(size_type dim, const allocator_type& al = allocator_type()) : MBase(al, dim, dim)
 		{ initialize(); }
 		explicit matrix(const allocator_type& al) : MBase(al) {}
 		explicit matrix(Index x, Index y, const allocator_type& al = allocator_type())
@@ -166,7 +219,7 @@ namespace my
 			: MBase(al, x, y)
 		{ initialize(val); }
 
-		matrix(const matrix& other) : MBase(other.alloc, other.sz)
+		matrix(const matrix& other) : MBase(other.alloc.inner_allocator(), other.sz.row, other.sz.col)
 		{
 			for (Index i = 0; i < other.sz.row; ++i)
 				std::uninitialized_copy(other.elem[i], other.elem[i] + other.sz.col, this->elem[i]);
@@ -177,10 +230,10 @@ namespace my
 
 			for (Index i = 0; i < this->sz.row; ++i)
 				for(Index j = 0; j < this->sz.col; ++j)
-					(this->alloc.inner_allocator()).destroy(&(this->elem[i][j]));
+					this->destroy_elem(&(this->elem[i][j]));
 
-			if (this->space.row < other.sz.row || this->space.col >= other.sz.col)
-				reserve(other.sz);
+			this->sz = {};
+			reserve(other.sz.row, other.sz.col);
 
 			for (Index i = 0; i < other.sz.row; ++i)
 				std::uninitialized_copy(other.elem[i], other.elem[i] + other.sz.col, this->elem[i]);
@@ -205,7 +258,7 @@ namespace my
 		{
 			for (Index i = 0; i < this->sz.row; ++i)
 				for (Index j = 0; j < this->sz.col; ++j)
-					(this->alloc.inner_allocator()).destroy(&(this->elem[i][j]));
+					this->destroy_elem(&(this->elem[i][j]));
 		}
 
 		Index count_rows() const { return this->sz.row; }
@@ -216,6 +269,8 @@ namespace my
 		T** data() { return this->elem; }
 		const T* const* data() const { return this->elem; }
 
+		// Iterators over the rows; they dereference to Row views by value, so iterate with
+		// 'auto&& row : mtx'.
 		iterator begin() { return iterator(this->elem, this->sz.col); }
 		iterator end() { return iterator(this->elem + this->sz.row, this->sz.col); }
 
@@ -225,14 +280,25 @@ namespace my
 		const_iterator cbegin() const { return const_iterator(this->elem, this->sz.col); }
 		const_iterator cend() const { return const_iterator(this->elem + this->sz.row, this->sz.col); }
 
-		std::reverse_iterator<iterator> rbegin() { return std::reverse_iterator<iterator>(iterator(this->elem + this->sz.row - 1, this->sz.col)); }
-		std::reverse_iterator<iterator> rend() { return std::reverse_iterator<iterator>(iterator(this->elem - 1, this->sz.col)); }
+		std::reverse_iterator<iterator> rbegin() { return std::reverse_iterator<iterator>(end()); }
+		std::reverse_iterator<iterator> rend() { return std::reverse_iterator<iterator>(begin()); }
+
+		std::reverse_iterator<const_iterator> rbegin() const { return std::reverse_iterator<const_iterator>(end()); }
+		std::reverse_iterator<const_iterator> rend() const { return std::reverse_iterator<const_iterator>(begin()); }
 
-		std::reverse_iterator<const_iterator> rbegin() const { return std::reverse_iterator<const_iterator>(const_iterator(this->elem + this->sz.row - 1, this->sz.col)); }
-		std::reverse_iterator<const_iterator> rend() const { return std::reverse_iterator<const_iterator>(const_iterator(this->elem - 1, this->sz.col)); }
+		std::reverse_iterator<const_iterator> rcbegin() const { return std::reverse_iterator<const_iterator>(cend()); }
+		std::reverse_iterator<const_iterator> rcend() const { return std::reverse_iterator<const_iterator>(cbegin()); }
 
-		std::reverse_iterator<const_iterator> rcbegin() const { return std::reverse_iterator<const_iterator>(const_iterator(this->elem + this->sz.row - 1, this->sz.col)); }
-		std::reverse_iterator<const_iterator> rcend() const { return std::reverse_iterator<const_iterator>(const_iterator(this->elem - 1, this->sz.col)); }
+		// All elements in row-major order, as one random access range, e.g. for
+		// std::transform(std::execution::par_unseq, ...) over the whole matrix.
+		ElementRange<element_iterator> elements()
+		{
+			return { element_iterator(this->elem, this->sz.col, 0), element_iterator(this->elem, this->sz.col, elements_end_row()) };
+		}
+		ElementRange<const_element_iterator> elements() const
+		{
+			return { const_element_iterator(this->elem, this->sz.col, 0), const_element_iterator(this->elem, this->sz.col, elements_end_row()) };
+		}
 
 		Row row(Index x)
 		{
@@ -277,72 +343,185 @@ namespace my
 				std::swap(this->elem[i][c1], this->elem[i][c2]);
 		}
 
-		void reserve_rows(Index newalloc)
+		// Reorders rows so that new row i is old row perm[i]. Only row pointers move.
+		template<class Container>
+		void permute_rows(const Container& perm)
 		{
-			if (newalloc > this->space.row)
+			check_permutation(perm, this->sz.row);
+
+			std::vector<T*> table(this->elem, this->elem + this->sz.row);
+			Index i = 0;
+			for (auto it = std::begin(perm); it != std::end(perm); ++it, ++i)
+				this->elem[i] = table[static_cast<Index>(*it)];
+		}
+
+		// Reorders columns so that new column j is old column perm[j]. The permutation is
+		// split into cycles once, then every row is permuted in place with one temporary.
+		template<class Container>
+		void permute_cols(const Container& perm)
+		{
+			check_permutation(perm, this->sz.col);
+
+			std::vector<Index> p(std::begin(perm), std::end(perm));
+			std::vector<Index> cycles; // cycle starts, each followed through p
+			std::vector<bool> visited(this->sz.col);
+			for (Index s = 0; s < this->sz.col; ++s)
+			{
+				if (visited[s] || p[s] == s) continue;
+				cycles.push_back(s);
+				for (Index j = s; !visited[j]; j = p[j])
+					visited[j] = true;
+			}
+			if (cycles.empty()) return;
+
+			for (Index i = 0; i < this->sz.row; ++i)
 			{
-				if (this->sz.row == 0)
+				T* r = this->elem[i];
+				for (Index s : cycles)
 				{
-					this->elem = this->alloc.allocate(newalloc);
-					this->space.row = newalloc;
+					T tmp = std::move(r[s]);
+					Index j = s;
+					for (; p[j] != s; j = p[j])
+						r[j] = std::move(r[p[j]]);
+					r[j] = std::move(tmp);
+				}
+			}
+		}
 
-					if (this->space.col > 0)
-					{
-						for (Index i = 0; i < this->space.row; ++i)
-							(this->alloc.inner_allocator()).allocate(this->space.col);
-					}
+		// Stable sort of the rows by comp(const Row&, const Row&). Only row pointers move.
+		template<class Compare>
+		void sort_rows(Compare comp)
+		{
+			const Index cols = this->sz.col;
+			std::stable_sort(this->elem, this->elem + this->sz.row, [&](T* a, T* b) {
+				return comp(Row(a, cols), Row(b, cols));
+			});
+		}
 
-					return;
-				}
+		// Stable sort of the rows by key(const Row&), evaluated once per row.
+		template<class KeyFn, class Compare = std::less<>>
+		void sort_rows_by(KeyFn key, Compare comp = Compare())
+		{
+			using Key = std::decay_t<decltype(key(std::declval<const Row&>()))>;
 
-				auto new_mtx = this->make_matrix(newalloc);
+			std::vector<std::pair<Key, T*>> keyed;
+			keyed.reserve(this->sz.row);
+			for (Index i = 0; i < this->sz.row; ++i)
+				keyed.emplace_back(key(Row(this->elem[i], this->sz.col)), this->elem[i]);
+
+			std::stable_sort(keyed.begin(), keyed.end(), [&](const auto& a, const auto& b) { return comp(a.first, b.first); });
+			for (Index i = 0; i < this->sz.row; ++i)
+				this->elem[i] = keyed[i].second;
+		}
+
+		// Stable sort of the rows by the values of column 'col'.
+		template<class Compare = std::less<>>
+		void sort_rows_by_column(Index col, Compare comp = Compare())
+		{
+			range_check(col, this->sz.col);
+			std::stable_sort(this->elem, this->elem + this->sz.row, [&](T* a, T* b) { return comp(a[col], b[col]); });
+		}
 
-				std::copy(this->elem, &(this->elem[this->sz.row]), new_mtx.get());
+		// New matrix made of rows indices[0], indices[1], ... (indices may repeat).
+		template<class Container>
+		matrix select_rows(const Container& indices) const
+		{
+			for (auto it = std::begin(indices); it != std::end(indices); ++it)
+				range_check(static_cast<Index>(*it), this->sz.row);
 
-				for (Index i = this->sz.row; i < newalloc; ++i)
-					new_mtx[i] = (this->alloc.inner_allocator()).allocate(this->space.col);
+			matrix result(static_cast<Index>(std::distance(std::begin(indices), std::end(indices))), this->sz.col, this->alloc.inner_allocator());
+			Index i = 0;
+			for (auto it = std::begin(indices); it != std::end(indices); ++it, ++i)
+				std::copy(this->elem[static_cast<Index>(*it)], this->elem[static_cast<Index>(*it)] + this->sz.col, result.elem[i]);
+			return result;
+		}
 
-				this->delete_matrix();
-				this->elem = new_mtx.release();
+		void reserve_rows(Index newalloc)
+		{
+			if (newalloc <= this->space.row) return;
 
-				this->space.row = newalloc;
+			auto new_mtx = this->make_matrix(newalloc);
+			if (this->elem != nullptr)
+				std::copy(this->elem, this->elem + this->space.row, new_mtx.get());
+
+			Index i = this->space.row;
+			if (this->space.col > 0)
+			{
+				try {
+					for (; i < newalloc; ++i)
+						new_mtx[i] = (this->alloc.inner_allocator()).allocate(this->space.col);
+				}
+				catch (...) {
+					for (Index k = this->space.row; k < i; ++k)
+						(this->alloc.inner_allocator()).deallocate(new_mtx[k], this->space.col);
+					throw;
+				}
 			}
+			else
+			{
+				std::fill(new_mtx.get() + i, new_mtx.get() + newalloc, nullptr);
+			}
+
+			this->delete_matrix();
+			this->elem = new_mtx.release();
+			this->space.row = newalloc;
 		}
 		void reserve_cols(Index newalloc)
 		{
-			if (this->sz.row == 0)
-				throw std::out_of_range{ "unable to reserve cols in matrix which has 0 rows" };
+			if (newalloc <= this->space.col) return;
 
-			if (newalloc > this->space.col)
-			{
-				if (this->space.col == 0)
-				{
-					for (Index i = 0; i < this->space.row; ++i)
-						this->elem[i] = (this->alloc.inner_allocator()).allocate(newalloc);
+			if (this->space.row == 0)
+				throw std::out_of_range{ "unable to reserve cols in matrix which has 0 rows" };
 
-					this->space.col = newalloc;
-					return;
-				}
-				
-				for (Index i = 0; i < this->sz.row; ++i)
+			// every row buffer (including spare rows beyond count_rows()) must have
+			// the same capacity, otherwise deallocation sizes would not match
+			auto new_rows = this->make_matrix(this->space.row);
+			Index i = 0;
+			try {
+				for (; i < this->space.row; ++i)
 				{
 					auto new_row = this->make_row(newalloc);
-
-					if (std::is_nothrow_move_constructible_v<T>)
+					if (i < this->sz.row)
 					{
-						my_uninitialized_move(this->elem[i], &(this->elem[i][this->sz.col]), new_row.get());
+						if (std::is_nothrow_move_constructible_v<T>)
+							my_uninitialized_move(this->elem[i], &(this->elem[i][this->sz.col]), new_row.get());
+						else
+							std::uninitialized_copy(this->elem[i], &(this->elem[i][this->sz.col]), new_row.get());
 					}
+					new_rows[i] = new_row.release();
+				}
+			}
+			catch (...) {
+				for (Index k = 0; k < i; ++k)
+				{
+					if (k < this->sz.row)
+						for (Index j = 0; j < this->sz.col; ++j)
+							this->destroy_elem(&new_rows[k][j]);
+					(this->alloc.inner_allocator()).deallocate(new_rows[k], newalloc);
+				}
+				throw;
+			}
+
+			for (i = 0; i < this->space.row; ++i)
+			{
+				if (this->space.col > 0)
+				{
+					if (i < this->sz.row)
+						this->delete_row(i);
 					else
-					{
-						std::uninitialized_copy(this->elem[i], &(this->elem[i][this->sz.col]), new_row.get());
-					}
+						(this->alloc.inner_allocator()).deallocate(this->elem[i], this->space.col);
+				}
+				this->elem[i] = new_rows[i];
+			}
 
-					this->delete_row(i);
-					this->elem[i] = new_row.release();
+			this->space.col = newalloc;
+		}
 
-					this->space.col = newalloc;
-				}				
-			}
+		void reserve(Index rows, Index cols)
+		{
+			reserve_rows(rows);
+			if (this->space.row > 0)
+				reserve_cols(cols);
 		}
 
 		void resize_rows(Index newsize)
@@ -353,7 +532,7 @@ namespace my
 				T val{};
 				for (Index i = this->sz.row; i < newsize; ++i)
 					for (Index j = 0; j < this->sz.col; ++j)
-						(this->alloc.inner_allocator()).construct(&(this->elem[i][j]), val);
+						this->construct_elem(&(this->elem[i][j]), val);
 
 				this->sz.row = newsize;
 			}
@@ -365,7 +544,7 @@ namespace my
 			{
 				for (Index i = this->sz.row; i < newsize; ++i)
 					for (Index j = 0; j < this->sz.col; ++j)
-						(this->alloc.inner_allocator()).construct(&(this->elem[i][j]), val);
+						this->construct_elem(&(this->elem[i][j]), val);
 
 				this->sz.row = newsize;
 			}
@@ -379,7 +558,7 @@ namespace my
 				T val{};
 				for (Index i = 0; i < this->sz.row; ++i)
 					for (Index j = this->sz.col; j < newsize; ++j)
-						(this->alloc.inner_allocator()).construct(&(this->elem[i][j]), val);
+						this->construct_elem(&(this->elem[i][j]), val);
 
 				this->sz.col = newsize;
 			}
@@ -391,7 +570,7 @@ namespace my
 			{
 				for (Index i = 0; i < this->sz.row; ++i)
 					for (Index j = this->sz.col; j < newsize; ++j)
-						(this->alloc.inner_allocator()).construct(&(this->elem[i][j]), val);
+						this->construct_elem(&(this->elem[i][j]), val);
 
 				this->sz.col = newsize;
 			}
@@ -404,10 +583,10 @@ namespace my
 			if (dist_ != this->sz.col)
 				throw std::out_of_range{ "columns count is not equal to new row" };
 
-			reserve(size_type(this->sz.row + 1, this->sz.col));
+			grow_rows();
 
 			for (Index i = 0; i < dist_; ++i, ++first)
-				(this->alloc.inner_allocator()).construct(&(this->elem[this->sz.row][i]), *first);
+				this->construct_elem(&(this->elem[this->sz.row][i]), *first);
 
 			this->sz.row += 1;
 		}
@@ -424,13 +603,12 @@ namespace my
 			if (dist_ != this->sz.col)
 				throw std::out_of_range{ "cols count is not equal to new row" };
 
-			reserve(size_type(this->sz.row + 1, this->sz.col));
-			for (Index i = this->sz.row; i > indx; --i)
-				std::swap(this->elem[i], this->elem[i - 1]);
-
+			grow_rows();
 			for (Index i = 0; i < dist_; ++i, ++first)
-				(this->alloc.inner_allocator()).construct(&(this->elem[indx][i]), *first);
+				this->construct_elem(&(this->elem[this->sz.row][i]), *first);
 
+			// the new row is built in the first spare row and rotated into place in one pass
+			std::rotate(this->elem + indx, this->elem + this->sz.row, this->elem + this->sz.row + 1);
 			this->sz.row++;
 			return iterator(this->elem + indx, this->sz.col);
 		}
@@ -474,15 +652,89 @@ namespace my
 			if (dist_ != this->sz.row)
 				throw std::out_of_range{ "rows count is not equal to new column" };
 
-			reserve(size_type(this->sz.row, this->sz.col + 1));
+			grow_cols(1);
+			fill_column(this->sz.col, first);
+			this->sz.col += 1;
+		}
+		template<class Container>
+		void add_column(const Container& cont) { add_column(std::cbegin(cont), std::cend(cont)); }
 
-			for (Index i = 0; i < dist_; ++i, ++first)
-				(this->alloc.inner_allocator()).construct(&(this->elem[i][this->sz.col]), *first);
+		// Inserts 'count' rows filled with 'val' before row 'indx' (indx == count_rows()
+		// appends). New rows are built in spare row buffers and the row table is rotated once.
+		void insert_rows(Index indx, Index count, const T& val = T())
+		{
+			range_check_insert(indx, count, this->sz.row);
+			if (count == 0) return;
+
+			grow_rows(count);
+			fill_block(this->sz.row, count, 0, this->sz.col, val);
 
+			std::rotate(this->elem + indx, this->elem + this->sz.row, this->elem + this->sz.row + count);
+			this->sz.row += count;
+		}
+
+		// Removes rows [first, first + count). Their buffers are kept as spare capacity.
+		void erase_rows(Index first, Index count)
+		{
+			range_check_erase(first, count, this->sz.row);
+			if (count == 0) return;
+
+			for (Index i = first; i < first + count; ++i)
+				for (Index j = 0; j < this->sz.col; ++j)
+					this->destroy_elem(&(this->elem[i][j]));
+
+			std::rotate(this->elem + first, this->elem + first + count, this->elem + this->sz.row);
+			this->sz.row -= count;
+		}
+		void erase_row(Index x) { erase_rows(x, 1); }
+
+		// Inserts a column before column 'indx' (indx == count_cols() appends).
+		template<class It>
+		void insert_column(Index indx, It first, It last)
+		{
+			if (std::distance(first, last) != this->sz.row)
+				throw std::out_of_range{ "rows count is not equal to new column" };
+			range_check_insert(indx, 1, this->sz.col);
+
+			// the whole column is built in the spare column before any row is rotated
+			grow_cols(1);
+			fill_column(this->sz.col, first);
+			for (Index i = 0; i < this->sz.row; ++i)
+				std::rotate(this->elem[i] + indx, this->elem[i] + this->sz.col, this->elem[i] + this->sz.col + 1);
 			this->sz.col += 1;
 		}
 		template<class Container>
-		void add_column(const Container& cont) { add_column(std::cbegin(cont), std::cend(cont)); }
+		void insert_column(Index indx, const Container& cont) { insert_column(indx, std::cbegin(cont), std::cend(cont)); }
+
+		// Inserts 'count' columns filled with 'val' before column 'indx'.
+		void insert_columns(Index indx, Index count, const T& val = T())
+		{
+			range_check_insert(indx, count, this->sz.col);
+			if (count == 0) return;
+
+			grow_cols(count);
+			fill_block(0, this->sz.row, this->sz.col, count, val);
+			for (Index i = 0; i < this->sz.row; ++i)
+				std::rotate(this->elem[i] + indx, this->elem[i] + this->sz.col, this->elem[i] + this->sz.col + count);
+			this->sz.col += count;
+		}
+
+		// Removes columns [first, first + count), shifting the rest of every row left once.
+		void erase_columns(Index first, Index count)
+		{
+			range_check_erase(first, count, this->sz.col);
+			if (count == 0) return;
+
+			for (Index i = 0; i < this->sz.row; ++i)
+			{
+				T* r = this->elem[i];
+				std::move(r + first + count, r + this->sz.col, r + first);
+				for (Index j = this->sz.col - count; j < this->sz.col; ++j)
+					this->destroy_elem(&r[j]);
+			}
+			this->sz.col -= count;
+		}
+		void erase_column(Index y) { erase_columns(y, 1); }
 
 		friend std::ostream& operator<<(std::ostream& os, const matrix& mtx)
 		{
@@ -499,11 +751,87 @@ namespace my
 		}
 
 	private:
+		// rows of zero length hold no elements, so that begin() == end()
+		Index elements_end_row() const { return this->sz.col == 0 ? 0 : this->sz.row; }
+
 		void range_check(Index x, Index n) const
 		{
 			if (x < 0 || x >= n)
 				throw std::out_of_range{ "index is out of range of matrix" };
 		}
+		template<class Container>
+		void check_permutation(const Container& perm, Index n) const
+		{
+			if (std::distance(std::begin(perm), std::end(perm)) != n)
+				throw std::invalid_argument{ "permutation size is not equal to matrix size" };
+
+			std::vector<bool> seen(n);
+			for (auto it = std::begin(perm); it != std::end(perm); ++it)
+			{
+				const auto k = static_cast<std::ptrdiff_t>(*it);
+				if (k < 0 || k >= n || seen[k])
+					throw std::invalid_argument{ "invalid permutation" };
+				seen[k] = true;
+			}
+		}
+		// Makes room for one more row, doubling the row capacity so that a sequence of
+		// add_row/insert_row calls reallocates the row table only O(log n) times.
+		void grow_rows(Index extra = 1)
+		{
+			if (this->sz.row + extra > this->space.row)
+				reserve_rows(std::max<Index>(this->sz.row + extra, this->space.row * 2));
+			if (this->space.row > 0)
+				reserve_cols(this->sz.col);
+		}
+		void grow_cols(Index extra)
+		{
+			if (this->sz.col + extra > this->space.col && this->space.row > 0)
+				reserve_cols(std::max<Index>(this->sz.col + extra, this->space.col * 2));
+		}
+		// Constructs copies of 'val' in rows [r0, r0 + nr), columns [c0, c0 + nc) of raw
+		// storage; on an exception the copies made so far are destroyed.
+		void fill_block(Index r0, Index nr, Index c0, Index nc, const T& val)
+		{
+			Index i = 0;
+			Index j = 0;
+			try {
+				for (; i < nr; ++i)
+					for (j = 0; j < nc; ++j)
+						this->construct_elem(&(this->elem[r0 + i][c0 + j]), val);
+			}
+			catch (...) {
+				for (Index k = 0; k <= i && k < nr; ++k)
+					for (Index m = 0; m < (k == i ? j : nc); ++m)
+						this->destroy_elem(&(this->elem[r0 + k][c0 + m]));
+				throw;
+			}
+		}
+		// Constructs column 'c' of raw storage in every row from consecutive values of
+		// 'first'; on an exception the elements made so far are destroyed.
+		template<class It>
+		void fill_column(Index c, It first)
+		{
+			Index i = 0;
+			try {
+				for (; i < this->sz.row; ++i, ++first)
+					this->construct_elem(&(this->elem[i][c]), *first);
+			}
+			catch (...) {
+				for (Index k = 0; k < i; ++k)
+					this->destroy_elem(&(this->elem[k][c]));
+				throw;
+			}
+		}
+		void range_check_insert(Index indx, Index count, Index n) const
+		{
+			if (indx < 0 || indx > n || count < 0)
+				throw std::out_of_range{ "index is out of range of matrix" };
+		}
+		void range_check_erase(Index first, Index count, Index n) const
+		{
+			if (first < 0 || count < 0 || first > n - count)
+				throw std::out_of_range{ "index is out of range of matrix" };
+		}
 		void initialize()
 		{
 			Index i = 0;
@@ -511,14 +839,14 @@ namespace my
 			try {
 				for (; i < this->sz.row; ++i)
 					for (j = 0; j < this->sz.col; ++j)
-						(this->alloc.inner_allocator()).construct(&(this->elem[i][j]));
+						this->construct_elem(&(this->elem[i][j]));
 			}
 			catch (const std::exception& exc) {
 				for (Index m = 0; m <= i; ++m)
 				{
 					Index k = (m == i) ? j : this->sz.col - 1;
 					for (Index n = 0; n <= k; ++n)
-						(this->alloc.inner_allocator()).destroy(&(this->elem[m][n]));
+						this->destroy_elem(&(this->elem[m][n]));
 				}
 
 				this->sz.row = 0;
@@ -531,7 +859,7 @@ namespace my
 				{
 					Index k = (m == i) ? j : this->sz.col - 1;
 					for (Index n = 0; n <= k; ++n)
-						(this->alloc.inner_allocator()).destroy(&(this->elem[m][n]));
+						this->destroy_elem(&(this->elem[m][n]));
 				}
 
 				this->sz.row = 0;
@@ -547,14 +875,14 @@ namespace my
 			try {
 				for (; i < this->sz.row; ++i)
 					for (j = 0; j < this->sz.col; ++j)
-						(this->alloc.inner_allocator()).construct(&(this->elem[i][j]), val);
+						this->construct_elem(&(this->elem[i][j]), val);
 			}
 			catch (const std::exception& exc) {
 				for (Index m = 0; m <= i; ++m)
 				{
 					Index k = (m == i) ? j : this->sz.col - 1;
 					for (Index n = 0; n <= k; ++n)
-						(this->alloc.inner_allocator()).destroy(&(this->elem[m][n]));
+						this->destroy_elem(&(this->elem[m][n]));
 				}
 
 				this->sz.row = 0;
@@ -567,7 +895,7 @@ namespace my
 				{
 					Index k = (m == i) ? j : this->sz.col - 1;
 					for (Index n = 0; n <= k; ++n)
-						(this->alloc.inner_allocator()).destroy(&(this->elem[m][n]));
+						this->destroy_elem(&(this->elem[m][n]));
 				}
 
 				this->sz.row = 0;
@@ -579,119 +907,181 @@ namespace my
 	};
 
 	template<class T, class A>
-	class matrix<T, A>::MatrixIterator : public std::iterator<std::random_access_iterator_tag, T>
+	class matrix<T, A>::MatrixIterator
 	{
 		friend class matrix<T, A>;
+		friend class ConstMatrixIterator;
 	private:
-		MatrixIterator(T** p, Index num) : p{ p }, row_{ *p, num } {}
+		MatrixIterator(T* const* p, Index num) noexcept : p{ p }, cols{ num } {}
 
 	public:
-		MatrixIterator(const MatrixIterator &it) : p{ it.p }, row_{ it.row_ } {}
-		MatrixIterator& operator =(const MatrixIterator&) = default;
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = matrix<T, A>::Row;
+		using difference_type = std::ptrdiff_t;
+		using pointer = detail::arrow_proxy<matrix<T, A>::Row>;
+		using reference = matrix<T, A>::Row;
+
+		MatrixIterator() noexcept {}
+
+		reference operator*() const noexcept { return reference(*p, cols); }
+		pointer operator->() const noexcept { return { reference(*p, cols) }; }
+		reference operator[](difference_type n) const noexcept { return reference(p[n], cols); }
+
+		MatrixIterator& operator++() noexcept { ++p; return *this; }
+		MatrixIterator operator++(int) noexcept { auto tmp = *this; ++p; return tmp; }
+		MatrixIterator& operator--() noexcept { --p; return *this; }
+		MatrixIterator operator--(int) noexcept { auto tmp = *this; --p; return tmp; }
+
+		MatrixIterator& operator+=(difference_type n) noexcept { p += n; return *this; }
+		MatrixIterator& operator-=(difference_type n) noexcept { p -= n; return *this; }
+		MatrixIterator operator+(difference_type n) const noexcept { return MatrixIterator(p + n, cols); }
+		MatrixIterator operator-(difference_type n) const noexcept { return MatrixIterator(p - n, cols); }
+		friend MatrixIterator operator+(difference_type n, const MatrixIterator& it) noexcept { return it + n; }
+		friend difference_type operator-(const MatrixIterator& a, const MatrixIterator& b) noexcept { return a.p - b.p; }
+
+		friend bool operator==(const MatrixIterator& a, const MatrixIterator& b) noexcept { return a.p == b.p; }
+		friend bool operator!=(const MatrixIterator& a, const MatrixIterator& b) noexcept { return a.p != b.p; }
+		friend bool operator<(const MatrixIterator& a, const MatrixIterator& b) noexcept { return a.p < b.p; }
+		friend bool operator>(const MatrixIterator& a, const MatrixIterator& b) noexcept { return a.p > b.p; }
+		friend bool operator<=(const MatrixIterator& a, const MatrixIterator& b) noexcept { return a.p <= b.p; }
+		friend bool operator>=(const MatrixIterator& a, const MatrixIterator& b) noexcept { return a.p >= b.p; }
 
-		inline bool operator==(MatrixIterator const& other) const { return p == other.p; }
-		inline bool operator!=(MatrixIterator const& other) const { return p != other.p; }
-
-		inline bool operator<(MatrixIterator const& other) const { return p < other.p; }
-		inline bool operator>(MatrixIterator const& other) const { return p > other.p; }
-
-		inline bool operator<=(MatrixIterator const& other) const { return p <= other.p; }
-		inline bool operator>=(MatrixIterator const& other) const { return p >= other.p; }
-
-		inline matrix<T, A>::Row& operator*() { return row_; }
-		inline matrix<T, A>::Row* operator->() noexcept { return &row_; }
+	private:
+		T* const* p{};
+		Index cols{};
+	};
 
-		inline MatrixIterator& operator++()
-		{
-			++p;
-			row_.elems = *p;
-			return *this;
-		}
-		inline MatrixIterator& operator++(int)
-		{
-			auto _tmp = *this;
-			this->operator++();
-			return _tmp;
-		}
+	template<class T, class A>
+	class matrix<T, A>::ConstMatrixIterator
+	{
+		friend class matrix<T, A>;
+	private:
+		ConstMatrixIterator(T* const* p, Index num) noexcept : p{ p }, cols{ num } {}
 
-		inline MatrixIterator& operator--()
-		{
-			--p;
-			row_.elems = *p;
-			return *this;
-		}
-		inline MatrixIterator& operator--(int)
-		{
-			auto _tmp = *this;
-			this->operator--();
-			return _tmp;
-		}
-		
-		inline Index operator-(const MatrixIterator& other) { return this->p - other.p; }
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = matrix<T, A>::Row;
+		using difference_type = std::ptrdiff_t;
+		using pointer = detail::arrow_proxy<const matrix<T, A>::Row>;
+		using reference = const matrix<T, A>::Row;
+
+		ConstMatrixIterator() noexcept {}
+		ConstMatrixIterator(const MatrixIterator& it) noexcept : p{ it.p }, cols{ it.cols } {}
+
+		reference operator*() const noexcept { return reference(*p, cols); }
+		pointer operator->() const noexcept { return { reference(*p, cols) }; }
+		reference operator[](difference_type n) const noexcept { return reference(p[n], cols); }
+
+		ConstMatrixIterator& operator++() noexcept { ++p; return *this; }
+		ConstMatrixIterator operator++(int) noexcept { auto tmp = *this; ++p; return tmp; }
+		ConstMatrixIterator& operator--() noexcept { --p; return *this; }
+		ConstMatrixIterator operator--(int) noexcept { auto tmp = *this; --p; return tmp; }
+
+		ConstMatrixIterator& operator+=(difference_type n) noexcept { p += n; return *this; }
+		ConstMatrixIterator& operator-=(difference_type n) noexcept { p -= n; return *this; }
+		ConstMatrixIterator operator+(difference_type n) const noexcept { return ConstMatrixIterator(p + n, cols); }
+		ConstMatrixIterator operator-(difference_type n) const noexcept { return ConstMatrixIterator(p - n, cols); }
+		friend ConstMatrixIterator operator+(difference_type n, const ConstMatrixIterator& it) noexcept { return it + n; }
+		friend difference_type operator-(const ConstMatrixIterator& a, const ConstMatrixIterator& b) noexcept { return a.p - b.p; }
+
+		friend bool operator==(const ConstMatrixIterator& a, const ConstMatrixIterator& b) noexcept { return a.p == b.p; }
+		friend bool operator!=(const ConstMatrixIterator& a, const ConstMatrixIterator& b) noexcept { return a.p != b.p; }
+		friend bool operator<(const ConstMatrixIterator& a, const ConstMatrixIterator& b) noexcept { return a.p < b.p; }
+		friend bool operator>(const ConstMatrixIterator& a, const ConstMatrixIterator& b) noexcept { return a.p > b.p; }
+		friend bool operator<=(const ConstMatrixIterator& a, const ConstMatrixIterator& b) noexcept { return a.p <= b.p; }
+		friend bool operator>=(const ConstMatrixIterator& a, const ConstMatrixIterator& b) noexcept { return a.p >= b.p; }
 
-		inline MatrixIterator operator+(Index indx) { return MatrixIterator(p + indx, row_.sz); }
-		inline MatrixIterator operator-(Index indx) { return MatrixIterator(p - indx, row_.sz); }
 	private:
-		T** p{};
-		matrix<T, A>::Row row_{};
+		T* const* p{};
+		Index cols{};
 	};
 
+	// Iterator over all elements in row-major order. Rows are separate allocations, so
+	// it is random access but not contiguous; it keeps the row and the column apart and
+	// only divides in the jumps of operator+=.
 	template<class T, class A>
-	class matrix<T, A>::ConstMatrixIterator : public std::iterator<std::random_access_iterator_tag, T, ptrdiff_t, T*, const T&>
+	template<class U>
+	class matrix<T, A>::BasicElementIterator
 	{
 		friend class matrix<T, A>;
+		template<class> friend class BasicElementIterator;
 	private:
-		ConstMatrixIterator(T** p, Index num) noexcept : p{ p }, row_{ *p, num } {}
+		BasicElementIterator(T* const* rows, Index cols, Index r) noexcept : rows{ rows }, cols{ cols }, r{ r } {}
 
 	public:
-		ConstMatrixIterator(const ConstMatrixIterator &it) noexcept : p{ it.p }, row_{ it.row_ } {}
-		ConstMatrixIterator& operator =(const ConstMatrixIterator&) = default;
-
-		inline bool operator==(ConstMatrixIterator const& other) const noexcept { return p == other.p; }
-		inline bool operator!=(ConstMatrixIterator const& other) const noexcept { return p != other.p; }
-
-		inline bool operator<(ConstMatrixIterator const& other) const noexcept { return p < other.p; }
-		inline bool operator>(ConstMatrixIterator const& other) const noexcept { return p > other.p; }
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = std::remove_cv_t<U>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = U*;
+		using reference = U&;
 
-		inline bool operator<=(ConstMatrixIterator const& other) const noexcept { return p <= other.p; }
-		inline bool operator>=(ConstMatrixIterator const& other) const noexcept { return p >= other.p; }
+		BasicElementIterator() noexcept {}
+		template<class V, class = std::enable_if_t<std::is_same_v<U, const V>>>
+		BasicElementIterator(const BasicElementIterator<V>& it) noexcept : rows{ it.rows }, cols{ it.cols }, r{ it.r }, c{ it.c } {}
 
-		inline const matrix<T, A>::Row& operator*() const noexcept { return row_; }
-		inline const matrix<T, A>::Row* operator->() const noexcept { return &row_; }
+		reference operator*() const noexcept { return rows[r][c]; }
+		pointer operator->() const noexcept { return rows[r] + c; }
+		reference operator[](difference_type n) const noexcept { return *(*this + n); }
 
-		inline ConstMatrixIterator& operator++() noexcept
+		BasicElementIterator& operator++() noexcept
 		{
-			++p;
-			row_.elems = *p;
+			if (++c == cols) { c = 0; ++r; }
 			return *this;
 		}
-		inline ConstMatrixIterator& operator++(int) noexcept
+		BasicElementIterator operator++(int) noexcept { auto tmp = *this; ++*this; return tmp; }
+		BasicElementIterator& operator--() noexcept
 		{
-			auto _tmp = *this;
-			this->operator++();
-			return _tmp;
+			if (c-- == 0) { c = cols - 1; --r; }
+			return *this;
 		}
+		BasicElementIterator operator--(int) noexcept { auto tmp = *this; --*this; return tmp; }
 
-		inline ConstMatrixIterator& operator--()
+		BasicElementIterator& operator+=(difference_type n) noexcept
 		{
-			--p;
-			row_.elems = *p;
+			if (cols == 0) return *this;
+			const difference_type i = static_cast<difference_type>(r) * cols + c + n;
+			r = static_cast<Index>(i / cols);
+			c = static_cast<Index>(i % cols);
 			return *this;
 		}
-		inline ConstMatrixIterator& operator--(int)
+		BasicElementIterator& operator-=(difference_type n) noexcept { return *this += -n; }
+		BasicElementIterator operator+(difference_type n) const noexcept { auto tmp = *this; return tmp += n; }
+		BasicElementIterator operator-(difference_type n) const noexcept { auto tmp = *this; return tmp += -n; }
+		friend BasicElementIterator operator+(difference_type n, const BasicElementIterator& it) noexcept { return it + n; }
+		friend difference_type operator-(const BasicElementIterator& a, const BasicElementIterator& b) noexcept
 		{
-			auto _tmp = *this;
-			this->operator--();
-			return _tmp;
+			return static_cast<difference_type>(a.r - b.r) * a.cols + (a.c - b.c);
 		}
 
-		inline Index operator-(const ConstMatrixIterator& other) { return this->p - other.p; }
+		friend bool operator==(const BasicElementIterator& a, const BasicElementIterator& b) noexcept { return a.r == b.r && a.c == b.c; }
+		friend bool operator!=(const BasicElementIterator& a, const BasicElementIterator& b) noexcept { return !(a == b); }
+		friend bool operator<(const BasicElementIterator& a, const BasicElementIterator& b) noexcept { return a.r < b.r || (a.r == b.r && a.c < b.c); }
+		friend bool operator>(const BasicElementIterator& a, const BasicElementIterator& b) noexcept { return b < a; }
+		friend bool operator<=(const BasicElementIterator& a, const BasicElementIterator& b) noexcept { return !(b < a); }
+		friend bool operator>=(const BasicElementIterator& a, const BasicElementIterator& b) noexcept { return !(a < b); }
 
-		inline ConstMatrixIterator operator+(Index indx) { return ConstMatrixIterator(p + indx, row_.sz); }
-		inline ConstMatrixIterator operator-(Index indx) { return ConstMatrixIterator(p - indx, row_.sz); }
 	private:
-		T** p{};
-		matrix<T, A>::Row row_{};
+		T* const* rows{};
+		Index cols{};
+		Index r{};
+		Index c{};
+	};
+
+	template<class T, class A>
+	template<class It>
+	class matrix<T, A>::ElementRange
+	{
+	public:
+		ElementRange(It first, It last) : first{ first }, last{ last } {}
+
+		It begin() const { return first; }
+		It end() const { return last; }
+		std::ptrdiff_t size() const { return last - first; }
+		bool empty() const { return first == last; }
+
+	private:
+		It first;
+		It last;
 	};
 
 	template<class T, class A>
@@ -727,14 +1117,7 @@ namespace my
 			: elems{ p }, sz { n } {}
 
 		Row(const Row& other) = default;
-		Row(Row&& other)
-		{
-			if (*this == other)
-				return;
-
-			this->elems = other.elems;
-			this->sz = other.sz;
-		}
+		Row(Row&& other) = default;
 
 	public:
 		Row& operator=(const Row& other) = default;
@@ -822,112 +1205,98 @@ namespace my
 		Index sz{};
 	};
 
+	// Iterators over the elements of a row. A row is contiguous, so under C++20 they model
+	// std::contiguous_iterator and std::to_address works on them.
 	template<class T, class A>
-	class matrix<T, A>::Row::MatrixRowIterator : public std::iterator<std::random_access_iterator_tag, T>
+	class matrix<T, A>::Row::MatrixRowIterator
 	{
 		friend class matrix<T, A>;
+		friend class ConstMatrixRowIterator;
 	private:
-		MatrixRowIterator(T* p) noexcept : p{ p } {}
+		explicit MatrixRowIterator(T* p) noexcept : p{ p } {}
 
 	public:
-		MatrixRowIterator(const MatrixRowIterator& it) noexcept : p{ it.p } {}
-		MatrixRowIterator& operator =(const MatrixRowIterator&) = default;
-
-		inline bool operator==(MatrixRowIterator const& other) const noexcept { return p == other.p; }
-		inline bool operator!=(MatrixRowIterator const& other) const noexcept { return p != other.p; }
-
-		inline bool operator<(MatrixRowIterator const& other) const noexcept { return p < other.p; }
-		inline bool operator>(MatrixRowIterator const& other) const noexcept { return p > other.p; }
-
-		inline bool operator<=(MatrixRowIterator const& other) const noexcept { return p <= other.p; }
-		inline bool operator>=(MatrixRowIterator const& other) const noexcept { return p >= other.p; }
-
-		inline T& operator*() const noexcept { return *p; }
-		inline T* operator->() const noexcept { return p; }
-
-		inline MatrixRowIterator& operator++() noexcept
-		{
-			++p;
-			return *this;
-		}
-		inline MatrixRowIterator& operator++(int) noexcept
-		{
-			auto _tmp = *this;
-			this->operator++();
-			return _tmp;
-		}
-
-		inline MatrixRowIterator& operator--() noexcept
-		{
-			--p;
-			return *this;
-		}
-		inline MatrixRowIterator& operator--(int) noexcept
-		{
-			auto _tmp = *this;
-			this->operator--();
-			return _tmp;
-		}
-
-		inline Index operator-(const MatrixRowIterator& other) { return this->p - other.p; }
+		using iterator_category = std::random_access_iterator_tag;
+#ifdef __cpp_lib_ranges
+		using iterator_concept = std::contiguous_iterator_tag;
+#endif
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = T*;
+		using reference = T&;
+
+		MatrixRowIterator() noexcept {}
+
+		reference operator*() const noexcept { return *p; }
+		pointer operator->() const noexcept { return p; }
+		reference operator[](difference_type n) const noexcept { return p[n]; }
+
+		MatrixRowIterator& operator++() noexcept { ++p; return *this; }
+		MatrixRowIterator operator++(int) noexcept { auto tmp = *this; ++p; return tmp; }
+		MatrixRowIterator& operator--() noexcept { --p; return *this; }
+		MatrixRowIterator operator--(int) noexcept { auto tmp = *this; --p; return tmp; }
+
+		MatrixRowIterator& operator+=(difference_type n) noexcept { p += n; return *this; }
+		MatrixRowIterator& operator-=(difference_type n) noexcept { p -= n; return *this; }
+		MatrixRowIterator operator+(difference_type n) const noexcept { return MatrixRowIterator(p + n); }
+		MatrixRowIterator operator-(difference_type n) const noexcept { return MatrixRowIterator(p - n); }
+		friend MatrixRowIterator operator+(difference_type n, const MatrixRowIterator& it) noexcept { return it + n; }
+		friend difference_type operator-(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept { return a.p - b.p; }
+
+		friend bool operator==(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept { return a.p == b.p; }
+		friend bool operator!=(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept { return a.p != b.p; }
+		friend bool operator<(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept { return a.p < b.p; }
+		friend bool operator>(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept { return a.p > b.p; }
+		friend bool operator<=(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept { return a.p <= b.p; }
+		friend bool operator>=(const MatrixRowIterator& a, const MatrixRowIterator& b) noexcept { return a.p >= b.p; }
 
-		inline MatrixRowIterator operator+(Index indx) { return MatrixRowIterator(p + indx); }
-		inline MatrixRowIterator operator-(Index indx) { return MatrixRowIterator(p - indx); }
 	private:
 		T* p{};
 	};
 
 	template<class T, class A>
-	class matrix<T, A>::Row::ConstMatrixRowIterator : public std::iterator<std::random_access_iterator_tag, T, ptrdiff_t, T*, const T&>
+	class matrix<T, A>::Row::ConstMatrixRowIterator
 	{
 		friend class matrix<T, A>;
 	private:
-		ConstMatrixRowIterator(T* p) noexcept : p{ p } {}
+		explicit ConstMatrixRowIterator(const T* p) noexcept : p{ p } {}
 
 	public:
-		ConstMatrixRowIterator(const ConstMatrixRowIterator &it) noexcept : p{ it.p } {}
-		ConstMatrixRowIterator& operator =(const ConstMatrixRowIterator&) = default;
-
-		inline bool operator==(ConstMatrixRowIterator const& other) const noexcept { return p == other.p; }
-		inline bool operator!=(ConstMatrixRowIterator const& other) const noexcept { return p != other.p; }
-
-		inline bool operator<(ConstMatrixRowIterator const& other) const noexcept { return p < other.p; }
-		inline bool operator>(ConstMatrixRowIterator const& other) const noexcept { return p > other.p; }
-
-		inline bool operator<=(ConstMatrixRowIterator const& other) const noexcept { return p <= other.p; }
-		inline bool operator>=(ConstMatrixRowIterator const& other) const noexcept { return p >= other.p; }
-
-		inline const T& operator*() const noexcept { return *p; }
-		inline const T* operator->() const noexcept { return p; }
-
-		inline ConstMatrixRowIterator& operator++() noexcept
-		{
-			++p;
-			return *this;
-		}
-		inline ConstMatrixRowIterator& operator++(int) noexcept
-		{
-			auto _tmp = *this;
-			this->operator++();
-			return _tmp;
-		}
-
-		inline ConstMatrixRowIterator& operator--() noexcept
-		{
-			--p;
-			return *this;
-		}
-		inline ConstMatrixRowIterator& operator--(int) noexcept
-		{
-			auto _tmp = *this;
-			this->operator--();
-			return _tmp;
-		}
-
-		Index operator-(const ConstMatrixRowIterator& other) { return this->p - other.p; }
+		using iterator_category = std::random_access_iterator_tag;
+#ifdef __cpp_lib_ranges
+		using iterator_concept = std::contiguous_iterator_tag;
+#endif
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const T*;
+		using reference = const T&;
+
+		ConstMatrixRowIterator() noexcept {}
+		ConstMatrixRowIterator(const MatrixRowIterator& it) noexcept : p{ it.p } {}
+
+		reference operator*() const noexcept { return *p; }
+		pointer operator->() const noexcept { return p; }
+		reference operator[](difference_type n) const noexcept { return p[n]; }
+
+		ConstMatrixRowIterator& operator++() noexcept { ++p; return *this; }
+		ConstMatrixRowIterator operator++(int) noexcept { auto tmp = *this; ++p; return tmp; }
+		ConstMatrixRowIterator& operator--() noexcept { --p; return *this; }
+		ConstMatrixRowIterator operator--(int) noexcept { auto tmp = *this; --p; return tmp; }
+
+		ConstMatrixRowIterator& operator+=(difference_type n) noexcept { p += n; return *this; }
+		ConstMatrixRowIterator& operator-=(difference_type n) noexcept { p -= n; return *this; }
+		ConstMatrixRowIterator operator+(difference_type n) const noexcept { return ConstMatrixRowIterator(p + n); }
+		ConstMatrixRowIterator operator-(difference_type n) const noexcept { return ConstMatrixRowIterator(p - n); }
+		friend ConstMatrixRowIterator operator+(difference_type n, const ConstMatrixRowIterator& it) noexcept { return it + n; }
+		friend difference_type operator-(const ConstMatrixRowIterator& a, const ConstMatrixRowIterator& b) noexcept { return a.p - b.p; }
+
+		friend bool operator==(const ConstMatrixRowIterator& a, const ConstMatrixRowIterator& b) noexcept { return a.p == b.p; }
+		friend bool operator!=(const ConstMatrixRowIterator& a, const ConstMatrixRowIterator& b) noexcept { return a.p != b.p; }
+		friend bool operator<(const ConstMatrixRowIterator& a, const ConstMatrixRowIterator& b) noexcept { return a.p < b.p; }
+		friend bool operator>(const ConstMatrixRowIterator& a, const ConstMatrixRowIterator& b) noexcept { return a.p > b.p; }
+		friend bool operator<=(const ConstMatrixRowIterator& a, const ConstMatrixRowIterator& b) noexcept { return a.p <= b.p; }
+		friend bool operator>=(const ConstMatrixRowIterator& a, const ConstMatrixRowIterator& b) noexcept { return a.p >= b.p; }
 
-		inline ConstMatrixRowIterator operator+(Index indx) { return ConstMatrixRowIterator(p + indx); }
-		inline ConstMatrixRowIterator operator-(Index indx) { return ConstMatrixRowIterator(p - indx); }
 	private:
 		const T* p{};
 	};
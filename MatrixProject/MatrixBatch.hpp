@@ -0,0 +1,310 @@
+#pragma once
+#ifndef MATRIX_BATCH_HPP
+#define MATRIX_BATCH_HPP
+
+#include<cmath>
+#include<vector>
+#include<string>
+#include<stdexcept>
+#include<algorithm>
+
+#include"Matrix.hpp"
+#include"AlignedAllocator.hpp"
+
+namespace my
+{
+	template<class T, class A>
+	class matrix_batch;
+
+	// Presents one item of a matrix_batch as a matrix. Batch is either matrix_batch<T, A>
+	// or const matrix_batch<T, A>.
+	template<class Batch>
+	class matrix_batch_item
+	{
+	public:
+		matrix_batch_item(Batch& batch, Index item) : batch_{ &batch }, item_{ item } {}
+
+		Index count_rows() const { return batch_->count_rows(); }
+		Index count_cols() const { return batch_->count_cols(); }
+		Index index() const { return item_; }
+
+		decltype(auto) at(Index x, Index y) const { return batch_->at(item_, x, y); }
+		decltype(auto) operator()(Index x, Index y) const { return batch_->lane(x, y)[item_]; }
+
+		template<class U, class A>
+		const matrix_batch_item& operator=(const matrix<U, A>& mtx) const
+		{
+			if (mtx.count_rows() != count_rows() || mtx.count_cols() != count_cols())
+				throw std::length_error{ "matrix should be equal to matrix_batch item by size" };
+
+			for (Index i = 0; i < count_rows(); ++i)
+				for (Index j = 0; j < count_cols(); ++j)
+					batch_->lane(i, j)[item_] = mtx.data()[i][j];
+
+			return *this;
+		}
+
+		template<class M = matrix<typename std::remove_const_t<Batch>::value_type>>
+		M to_matrix() const
+		{
+			M result(count_rows(), count_cols());
+			for (Index i = 0; i < count_rows(); ++i)
+				for (Index j = 0; j < count_cols(); ++j)
+					result.data()[i][j] = batch_->lane(i, j)[item_];
+			return result;
+		}
+
+	private:
+		Batch* batch_{};
+		Index item_{};
+	};
+
+	// Collection of equally shaped small matrices stored as a structure of arrays: element
+	// (x, y) of all items is one contiguous lane of count() values, so loops over the items
+	// are unit-stride and vectorize. Intended for millions of 3x3 .. 8x8 matrices.
+	template<class T, class A = aligned_allocator<T>>
+	class matrix_batch
+	{
+	public:
+		using value_type = T;
+		using allocator_type = A;
+		using item_type = matrix_batch_item<matrix_batch>;
+		using const_item_type = matrix_batch_item<const matrix_batch>;
+
+		matrix_batch() {}
+		explicit matrix_batch(Index count, Index rows, Index cols, const T& val = T{}, const allocator_type& al = allocator_type())
+			: count_{ count }, rows_{ rows }, cols_{ cols }, elems_(al)
+		{
+			if (count < 0 || rows < 0 || cols < 0)
+				throw std::invalid_argument{ "matrix_batch size arguments must be positive" };
+
+			elems_.assign(static_cast<std::size_t>(count) * rows * cols, val);
+		}
+
+		Index count() const { return count_; }
+		Index count_rows() const { return rows_; }
+		Index count_cols() const { return cols_; }
+
+		// Contiguous values of element (x, y) of every item. No range checking.
+		T* lane(Index x, Index y) { return elems_.data() + (static_cast<std::size_t>(x) * cols_ + y) * count_; }
+		const T* lane(Index x, Index y) const { return elems_.data() + (static_cast<std::size_t>(x) * cols_ + y) * count_; }
+
+		T* data() { return elems_.data(); }
+		const T* data() const { return elems_.data(); }
+
+		T& at(Index item, Index x, Index y)
+		{
+			range_check(item, x, y);
+			return lane(x, y)[item];
+		}
+		const T& at(Index item, Index x, Index y) const
+		{
+			range_check(item, x, y);
+			return lane(x, y)[item];
+		}
+
+		item_type item(Index k)
+		{
+			range_check(k, 0, 0);
+			return item_type(*this, k);
+		}
+		const_item_type item(Index k) const
+		{
+			range_check(k, 0, 0);
+			return const_item_type(*this, k);
+		}
+		item_type operator[](Index k) { return item(k); }
+		const_item_type operator[](Index k) const { return item(k); }
+
+	private:
+		void range_check(Index item, Index x, Index y) const
+		{
+			if (item < 0 || item >= count_ || x < 0 || (x >= rows_ && rows_ > 0) || y < 0 || (y >= cols_ && cols_ > 0))
+				throw std::out_of_range{ "index is out of range of matrix_batch" };
+		}
+
+		Index count_{};
+		Index rows_{};
+		Index cols_{};
+		std::vector<T, A> elems_;
+	};
+
+	// C[k] = A[k] * B[k] for every item k.
+	template<class T, class A>
+	matrix_batch<T, A> multiply(const matrix_batch<T, A>& a, const matrix_batch<T, A>& b)
+	{
+		if (a.count() != b.count())
+			throw std::invalid_argument{ "matrix batches should be equal by count" };
+		if (a.count_cols() != b.count_rows())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+
+		const Index n = a.count();
+		matrix_batch<T, A> result(n, a.count_rows(), b.count_cols());
+		for (Index i = 0; i < a.count_rows(); ++i)
+		{
+			for (Index j = 0; j < b.count_cols(); ++j)
+			{
+				T* c = result.lane(i, j);
+				for (Index p = 0; p < a.count_cols(); ++p)
+				{
+					const T* x = a.lane(i, p);
+					const T* y = b.lane(p, j);
+					for (Index k = 0; k < n; ++k)
+						c[k] += x[k] * y[k];
+				}
+			}
+		}
+		return result;
+	}
+
+	template<class T, class A>
+	matrix_batch<T, A> transpose(const matrix_batch<T, A>& a)
+	{
+		matrix_batch<T, A> result(a.count(), a.count_cols(), a.count_rows());
+		for (Index i = 0; i < a.count_rows(); ++i)
+			for (Index j = 0; j < a.count_cols(); ++j)
+				std::copy(a.lane(i, j), a.lane(i, j) + a.count(), result.lane(j, i));
+		return result;
+	}
+
+	namespace detail
+	{
+		// Gaussian elimination with partial pivoting on every item of the batch at once,
+		// solving A[k] * X[k] = B[k] in place: 'a' is destroyed, 'b' is replaced by X.
+		// Pivot rows differ between items, so row exchanges are done with per-item selects
+		// which keep the lane loops branch free.
+		template<class T, class A>
+		void batch_gauss_solve(matrix_batch<T, A>& a, matrix_batch<T, A>& b)
+		{
+			const Index n = a.count_rows();
+			const Index m = b.count_cols();
+			const Index count = a.count();
+
+			std::vector<Index> pivot(count);
+			std::vector<T> best(count);
+
+			auto swap_if = [&](T* upper, T* lower, Index r) {
+				for (Index k = 0; k < count; ++k)
+				{
+					const bool sel = pivot[k] == r;
+					const T u = upper[k];
+					const T l = lower[k];
+					upper[k] = sel ? l : u;
+					lower[k] = sel ? u : l;
+				}
+			};
+
+			for (Index c = 0; c < n; ++c)
+			{
+				{
+					const T* col = a.lane(c, c);
+					for (Index k = 0; k < count; ++k)
+					{
+						pivot[k] = c;
+						best[k] = std::abs(col[k]);
+					}
+				}
+				for (Index r = c + 1; r < n; ++r)
+				{
+					const T* col = a.lane(r, c);
+					for (Index k = 0; k < count; ++k)
+					{
+						const T v = std::abs(col[k]);
+						const bool sel = v > best[k];
+						best[k] = sel ? v : best[k];
+						pivot[k] = sel ? r : pivot[k];
+					}
+				}
+
+				for (Index k = 0; k < count; ++k)
+				{
+					if (best[k] == T{})
+						throw std::domain_error{ "matrix " + std::to_string(k) + " of matrix_batch is singular" };
+				}
+
+				for (Index r = c + 1; r < n; ++r)
+				{
+					for (Index j = c; j < n; ++j)
+						swap_if(a.lane(c, j), a.lane(r, j), r);
+					for (Index j = 0; j < m; ++j)
+						swap_if(b.lane(c, j), b.lane(r, j), r);
+				}
+
+				const T* diag = a.lane(c, c);
+				for (Index r = c + 1; r < n; ++r)
+				{
+					T* factor = a.lane(r, c);
+					for (Index k = 0; k < count; ++k)
+						factor[k] /= diag[k];
+
+					for (Index j = c + 1; j < n; ++j)
+					{
+						const T* src = a.lane(c, j);
+						T* dst = a.lane(r, j);
+						for (Index k = 0; k < count; ++k)
+							dst[k] -= factor[k] * src[k];
+					}
+					for (Index j = 0; j < m; ++j)
+					{
+						const T* src = b.lane(c, j);
+						T* dst = b.lane(r, j);
+						for (Index k = 0; k < count; ++k)
+							dst[k] -= factor[k] * src[k];
+					}
+				}
+			}
+
+			for (Index c = n - 1; c >= 0; --c)
+			{
+				const T* diag = a.lane(c, c);
+				for (Index j = 0; j < m; ++j)
+				{
+					T* x = b.lane(c, j);
+					for (Index r = c + 1; r < n; ++r)
+					{
+						const T* u = a.lane(c, r);
+						const T* xr = b.lane(r, j);
+						for (Index k = 0; k < count; ++k)
+							x[k] -= u[k] * xr[k];
+					}
+					for (Index k = 0; k < count; ++k)
+						x[k] /= diag[k];
+				}
+			}
+		}
+	}
+
+	// Solves A[k] * X[k] = B[k] for every item by LU decomposition with partial pivoting.
+	// Throws std::domain_error if any item of A is singular.
+	template<class T, class A>
+	matrix_batch<T, A> lu_solve(const matrix_batch<T, A>& a, const matrix_batch<T, A>& b)
+	{
+		if (a.count_rows() != a.count_cols())
+			throw std::invalid_argument{ "lu_solve requires square matrices" };
+		if (a.count() != b.count() || a.count_rows() != b.count_rows())
+			throw std::invalid_argument{ "matrix batches for lu_solve should be equal by count and rows count" };
+
+		matrix_batch<T, A> lu(a);
+		matrix_batch<T, A> x(b);
+		detail::batch_gauss_solve(lu, x);
+		return x;
+	}
+
+	// Inverse of every item. Throws std::domain_error if any item is singular.
+	template<class T, class A>
+	matrix_batch<T, A> inverse(const matrix_batch<T, A>& a)
+	{
+		if (a.count_rows() != a.count_cols())
+			throw std::invalid_argument{ "inverse requires square matrices" };
+
+		matrix_batch<T, A> lu(a);
+		matrix_batch<T, A> x(a.count(), a.count_rows(), a.count_cols());
+		for (Index i = 0; i < a.count_rows(); ++i)
+			std::fill(x.lane(i, i), x.lane(i, i) + a.count(), T{ 1 });
+
+		detail::batch_gauss_solve(lu, x);
+		return x;
+	}
+}
+
+#endif // MATRIX_BATCH_HPP
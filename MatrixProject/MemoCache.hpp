@@ -0,0 +1,360 @@
+#pragma once
+#ifndef MEMO_CACHE_HPP
+#define MEMO_CACHE_HPP
+
+#include<list>
+#include<mutex>
+#include<memory>
+#include<string>
+#include<vector>
+#include<cstdint>
+#include<cstring>
+#include<utility>
+#include<stdexcept>
+#include<functional>
+#include<type_traits>
+#include<unordered_map>
+
+#include"Matrix.hpp"
+#include"Backend.hpp"
+
+namespace my
+{
+	namespace detail
+	{
+		constexpr std::uint32_t hash_prime1 = 0x9E3779B1u;
+		constexpr std::uint32_t hash_prime2 = 0x85EBCA77u;
+		constexpr Index hash_lanes = 8;
+
+		inline std::uint64_t mix64(std::uint64_t h)
+		{
+			h ^= h >> 30;
+			h *= 0xBF58476D1CE4E5B9ull;
+			h ^= h >> 27;
+			h *= 0x94D049BB133111EBull;
+			h ^= h >> 31;
+			return h;
+		}
+
+		inline std::uint32_t rotl32(std::uint32_t x, int r) { return (x << r) | (x >> (32 - r)); }
+
+		// Hash of a byte range in hash_lanes independent 32-bit lanes (the round of
+		// xxHash32), which the compiler keeps in one SIMD register.
+		inline std::uint64_t hash_bytes(const unsigned char* p, std::size_t n)
+		{
+			std::uint32_t acc[hash_lanes];
+			for (Index l = 0; l < hash_lanes; ++l)
+				acc[l] = hash_prime1 * static_cast<std::uint32_t>(l + 1);
+
+			constexpr std::size_t block = sizeof(std::uint32_t) * hash_lanes;
+			std::uint32_t w[hash_lanes];
+			std::size_t i = 0;
+			for (; i + block <= n; i += block)
+			{
+				std::memcpy(w, p + i, block);
+				for (Index l = 0; l < hash_lanes; ++l)
+					acc[l] = rotl32(acc[l] + w[l] * hash_prime2, 13) * hash_prime1;
+			}
+			if (i < n)
+			{
+				std::memset(w, 0, block);
+				std::memcpy(w, p + i, n - i);
+				for (Index l = 0; l < hash_lanes; ++l)
+					acc[l] = rotl32(acc[l] + w[l] * hash_prime2, 13) * hash_prime1;
+			}
+
+			std::uint64_t h = mix64(n);
+			for (Index l = 0; l < hash_lanes; ++l)
+				h = mix64(h ^ acc[l]);
+			return h;
+		}
+
+		// Hash of the values of a row: their bytes for integers and floating point (so
+		// that 0.0 and -0.0 differ), std::hash of each value otherwise.
+		template<class T>
+		std::uint64_t hash_row(const T* p, Index n)
+		{
+			if constexpr (std::has_unique_object_representations_v<T> || std::is_floating_point_v<T>)
+				return hash_bytes(reinterpret_cast<const unsigned char*>(p), static_cast<std::size_t>(n) * sizeof(T));
+			else
+			{
+				std::uint64_t h = mix64(static_cast<std::uint64_t>(n));
+				for (Index i = 0; i < n; ++i)
+					h = mix64(h ^ static_cast<std::uint64_t>(std::hash<T>{}(p[i])));
+				return h;
+			}
+		}
+
+		// Combines the row hashes in order together with the sizes of the matrix.
+		inline std::uint64_t combine_rows(const std::uint64_t* row_hashes, Index rows, Index cols)
+		{
+			std::uint64_t h = mix64(static_cast<std::uint64_t>(rows) * hash_prime1 + static_cast<std::uint64_t>(cols));
+			for (Index i = 0; i < rows; ++i)
+				h = mix64(h + row_hashes[i]);
+			return h;
+		}
+	}
+
+	// 64-bit hash of the sizes and contents of a matrix, computed in one pass over it.
+	// Equal hashes of different contents are possible but improbable (about 2^-64 per
+	// pair of matrices).
+	template<class T, class A>
+	std::uint64_t content_hash(const matrix<T, A>& m)
+	{
+		std::vector<std::uint64_t> rows(m.count_rows());
+		for (Index i = 0; i < m.count_rows(); ++i)
+			rows[i] = detail::hash_row(m.data()[i], m.count_cols());
+		return detail::combine_rows(rows.data(), m.count_rows(), m.count_cols());
+	}
+
+	// Matrix that caches its content_hash. Every non-const accessor marks what it exposes
+	// as dirty: at() and mutable_row() their row, modify() the whole matrix. hash()
+	// rehashes the dirty rows only, so after a few row changes it costs O(cols) per
+	// changed row plus O(rows).
+	//
+	// As with cow_matrix, a non-const access counts as the write: references and rows
+	// obtained from it must not be written through after the next call to hash(). hash()
+	// updates the cache and is not safe to call concurrently on the same object.
+	template<class T, class A = std::allocator<T>>
+	class hashed_matrix
+	{
+	public:
+		using value_type = T;
+		using matrix_type = matrix<T, A>;
+
+		hashed_matrix() {}
+		explicit hashed_matrix(matrix_type m) : mtx{ std::move(m) } {}
+
+		Index count_rows() const { return mtx.count_rows(); }
+		Index count_cols() const { return mtx.count_cols(); }
+
+		const matrix_type& get() const { return mtx; }
+		operator const matrix_type&() const { return mtx; }
+
+		const T& at(Index x, Index y) const { return mtx.at(x, y); }
+		T& at(Index x, Index y)
+		{
+			T& result = mtx.at(x, y);
+			mark_row(x);
+			return result;
+		}
+
+		// Read-only row of count_cols() elements. A matrix::Row would not do here: copies of a
+		// const Row are writable and would bypass the dirty tracking.
+		const T* row(Index x) const
+		{
+			range_check(x);
+			return mtx.data()[x];
+		}
+		typename matrix_type::Row mutable_row(Index x)
+		{
+			range_check(x);
+			mark_row(x);
+			return mtx.row(x);
+		}
+
+		// Full access, for changes of sizes or of many rows.
+		matrix_type& modify()
+		{
+			all_dirty = true;
+			return mtx;
+		}
+
+		matrix_type release()
+		{
+			all_dirty = true;
+			return std::move(mtx);
+		}
+
+		std::uint64_t hash() const
+		{
+			const Index rows = mtx.count_rows();
+			if (all_dirty || static_cast<Index>(row_hashes.size()) != rows)
+			{
+				row_hashes.resize(rows);
+				for (Index i = 0; i < rows; ++i)
+					row_hashes[i] = detail::hash_row(mtx.data()[i], mtx.count_cols());
+			}
+			else if (dirty_rows.empty() && combined_valid)
+				return combined;
+			else
+				for (Index i : dirty_rows)
+					row_hashes[i] = detail::hash_row(mtx.data()[i], mtx.count_cols());
+
+			all_dirty = false;
+			dirty_rows.clear();
+			combined = detail::combine_rows(row_hashes.data(), rows, mtx.count_cols());
+			combined_valid = true;
+			return combined;
+		}
+
+	private:
+		void range_check(Index x) const
+		{
+			if (x < 0 || x >= mtx.count_rows())
+				throw std::out_of_range{ "index is out of range of matrix" };
+		}
+		void mark_row(Index x)
+		{
+			if (!all_dirty && (dirty_rows.empty() || dirty_rows.back() != x))
+				dirty_rows.push_back(x);
+			// past one entry per row a full rehash is cheaper to track
+			if (static_cast<Index>(dirty_rows.size()) > mtx.count_rows())
+			{
+				all_dirty = true;
+				dirty_rows.clear();
+			}
+			combined_valid = false;
+		}
+
+		matrix_type mtx;
+		mutable std::vector<std::uint64_t> row_hashes;
+		mutable std::vector<Index> dirty_rows;
+		mutable std::uint64_t combined{};
+		mutable bool all_dirty{ true };
+		mutable bool combined_valid{ false };
+	};
+
+	template<class T, class A>
+	std::uint64_t content_hash(const hashed_matrix<T, A>& m) { return m.hash(); }
+
+	// Key of a memoized call: the name of the operation and the hashes of its operands.
+	struct memo_key
+	{
+		std::string op;
+		std::vector<std::uint64_t> operands;
+
+		bool operator==(const memo_key& other) const { return op == other.op && operands == other.operands; }
+		bool operator!=(const memo_key& other) const { return !(*this == other); }
+	};
+
+	namespace detail
+	{
+		struct memo_key_hash
+		{
+			std::size_t operator()(const memo_key& k) const
+			{
+				std::uint64_t h = std::hash<std::string>{}(k.op);
+				for (std::uint64_t o : k.operands)
+					h = mix64(h ^ o);
+				return static_cast<std::size_t>(h);
+			}
+		};
+	}
+
+	// Bounded LRU cache of results of type Result keyed by memo_key. Results are shared
+	// and immutable, so a returned result stays valid after it is evicted. Thread safe;
+	// the computation itself runs outside the lock, so two threads missing the same key
+	// at once may both compute it.
+	template<class Result>
+	class memo_cache
+	{
+	public:
+		explicit memo_cache(std::size_t capacity) : cap{ capacity }
+		{
+			if (capacity == 0)
+				throw std::invalid_argument{ "memo_cache must hold at least 1 result" };
+		}
+
+		memo_cache(const memo_cache&) = delete;
+		memo_cache& operator=(const memo_cache&) = delete;
+
+		std::shared_ptr<const Result> find(const memo_key& key)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			auto found = entries.find(key);
+			if (found == entries.end())
+			{
+				++miss_count;
+				return {};
+			}
+			++hit_count;
+			lru.splice(lru.begin(), lru, found->second);
+			return found->second->second;
+		}
+
+		std::shared_ptr<const Result> insert(const memo_key& key, std::shared_ptr<const Result> value)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			auto found = entries.find(key);
+			if (found != entries.end())
+			{
+				lru.splice(lru.begin(), lru, found->second);
+				return found->second->second;
+			}
+
+			if (entries.size() == cap)
+			{
+				entries.erase(lru.back().first);
+				lru.pop_back();
+			}
+			lru.emplace_front(key, std::move(value));
+			entries.emplace(key, lru.begin());
+			return lru.front().second;
+		}
+
+		// Stored result for key, or the result of compute() stored under key.
+		template<class F>
+		std::shared_ptr<const Result> get_or_compute(const memo_key& key, F compute)
+		{
+			if (auto found = find(key))
+				return found;
+			return insert(key, std::make_shared<const Result>(compute()));
+		}
+
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			entries.clear();
+			lru.clear();
+		}
+
+		std::size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return entries.size();
+		}
+		std::size_t capacity() const { return cap; }
+
+		std::size_t hits() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return hit_count;
+		}
+		std::size_t misses() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return miss_count;
+		}
+
+	private:
+		using lru_list = std::list<std::pair<memo_key, std::shared_ptr<const Result>>>;
+
+		std::size_t cap;
+		lru_list lru;
+		std::unordered_map<memo_key, typename lru_list::iterator, detail::memo_key_hash> entries;
+		std::size_t hit_count{};
+		std::size_t miss_count{};
+		mutable std::mutex mtx;
+	};
+
+	// Memoized f(operands...) under the operation name op; operands are matrices or
+	// hashed_matrix objects and are passed to f as they are. For example an inverse:
+	//
+	//     auto inv = memoize(cache, "inverse", [](const matrix<double>& a) { return inverse(a); }, a);
+	template<class Result, class F, class... Operands>
+	std::shared_ptr<const Result> memoize(memo_cache<Result>& cache, std::string op, F f, const Operands&... operands)
+	{
+		memo_key key{ std::move(op), { content_hash(operands)... } };
+		return cache.get_or_compute(key, [&] { return f(operands...); });
+	}
+
+	// Memoized multiply (Backend.hpp).
+	template<class T, class A, class MA, class MB>
+	std::shared_ptr<const matrix<T, A>> cached_multiply(memo_cache<matrix<T, A>>& cache, const MA& a, const MB& b)
+	{
+		return memoize(cache, "multiply", [](const matrix<T, A>& x, const matrix<T, A>& y) { return multiply(x, y); }, a, b);
+	}
+}
+
+#endif // MEMO_CACHE_HPP
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include<thread>
+#include<vector>
+#include<exception>
+#include<algorithm>
+
+#include"Matrix.hpp"
+
+namespace my
+{
+	inline Index hardware_threads()
+	{
+		const unsigned n = std::thread::hardware_concurrency();
+		return n == 0 ? 1 : static_cast<Index>(n);
+	}
+
+	namespace detail
+	{
+		// count * c / chunks without overflowing for counts close to the Index limit.
+		inline Index chunk_offset(Index count, Index c, Index chunks)
+		{
+			return count / chunks * c + count % chunks * c / chunks;
+		}
+	}
+
+	// Splits [first, last) into at most hardware_threads() contiguous chunks of at least
+	// 'grain' indices and calls f(chunk_first, chunk_last) for each of them, one chunk on
+	// the calling thread and the rest on worker threads. The first exception thrown by
+	// any chunk is rethrown after all of them have finished.
+	template<class F>
+	void parallel_for(Index first, Index last, Index grain, F&& f)
+	{
+		const Index count = last - first;
+		if (count <= 0) return;
+
+		grain = std::max<Index>(grain, 1);
+		const Index chunks = std::min<Index>(hardware_threads(), (count + grain - 1) / grain);
+		if (chunks <= 1)
+		{
+			f(first, last);
+			return;
+		}
+
+		std::vector<std::exception_ptr> errors(chunks);
+		std::vector<std::thread> workers;
+		workers.reserve(chunks - 1);
+
+		auto run = [&](Index c) {
+			const Index b = first + detail::chunk_offset(count, c, chunks);
+			const Index e = first + detail::chunk_offset(count, c + 1, chunks);
+			try { f(b, e); }
+			catch (...) { errors[c] = std::current_exception(); }
+		};
+
+		for (Index c = 1; c < chunks; ++c)
+			workers.emplace_back(run, c);
+
+		run(0);
+
+		for (auto& w : workers)
+			w.join();
+
+		for (auto& e : errors)
+			if (e) std::rethrow_exception(e);
+	}
+}
+
+#endif // PARALLEL_HPP
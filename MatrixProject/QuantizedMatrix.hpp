@@ -0,0 +1,391 @@
+#pragma once
+#ifndef QUANTIZED_MATRIX_HPP
+#define QUANTIZED_MATRIX_HPP
+
+#include<cmath>
+#include<cstdint>
+#include<vector>
+#include<stdexcept>
+#include<numeric>
+#include<algorithm>
+#include<type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512VNNI__)
+#include<immintrin.h>
+#endif
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"AlignedAllocator.hpp"
+
+namespace my
+{
+	enum class quantization { per_tensor, per_row };
+
+	// Limits of the quantized values. int8 is restricted to the symmetric range
+	// [-127, 127] so that products of two values never saturate 16-bit pair sums in the
+	// pmaddubsw-style kernels (2 * 127 * 127 < 2^15).
+	template<class Q>
+	struct quantized_limits;
+
+	template<>
+	struct quantized_limits<std::int8_t>
+	{
+		static constexpr std::int32_t min = -127;
+		static constexpr std::int32_t max = 127;
+	};
+
+	template<>
+	struct quantized_limits<std::uint8_t>
+	{
+		static constexpr std::int32_t min = 0;
+		static constexpr std::int32_t max = 255;
+	};
+
+	// Matrix of 8-bit values with affine quantization: real = scale * (q - zero_point),
+	// with one (scale, zero_point) pair for the whole matrix or one per row. Rows are
+	// stored contiguously with the leading dimension padded to a whole cache line; the
+	// padding is zero.
+	template<class Q>
+	class quantized_matrix
+	{
+		static_assert(std::is_same_v<Q, std::int8_t> || std::is_same_v<Q, std::uint8_t>, "quantized_matrix supports int8_t and uint8_t");
+
+	public:
+		using value_type = Q;
+
+		quantized_matrix() {}
+		explicit quantized_matrix(Index rows, Index cols, quantization mode = quantization::per_tensor)
+			: rows_{ rows }, cols_{ cols }, mode_{ mode }
+		{
+			if (rows < 0 || cols < 0)
+				throw std::invalid_argument{ "quantized_matrix size arguments must be positive" };
+
+			ld_ = static_cast<Index>(detail::round_up(static_cast<std::size_t>(cols), cache_line_size));
+			elems_.assign(static_cast<std::size_t>(rows) * ld_, Q{});
+
+			const Index params = mode == quantization::per_row ? rows : 1;
+			scale_.assign(params, 1.0f);
+			zero_point_.assign(params, 0);
+		}
+
+		Index count_rows() const { return rows_; }
+		Index count_cols() const { return cols_; }
+		Index leading_dimension() const { return ld_; }
+		quantization mode() const { return mode_; }
+
+		Q* row(Index x) { return elems_.data() + static_cast<std::size_t>(x) * ld_; }
+		const Q* row(Index x) const { return elems_.data() + static_cast<std::size_t>(x) * ld_; }
+
+		Q& at(Index x, Index y)
+		{
+			range_check(x, y);
+			return row(x)[y];
+		}
+		const Q& at(Index x, Index y) const
+		{
+			range_check(x, y);
+			return row(x)[y];
+		}
+
+		// Quantization parameters that apply to row x.
+		float scale(Index x) const { return scale_[mode_ == quantization::per_row ? x : 0]; }
+		std::int32_t zero_point(Index x) const { return zero_point_[mode_ == quantization::per_row ? x : 0]; }
+
+		void set_parameters(Index x, float scale, std::int32_t zero_point)
+		{
+			if (!(scale > 0.0f))
+				throw std::invalid_argument{ "quantization scale must be positive" };
+			if (zero_point < quantized_limits<Q>::min || zero_point > quantized_limits<Q>::max)
+				throw std::out_of_range{ "quantization zero point is out of range of the quantized type" };
+
+			const Index p = mode_ == quantization::per_row ? x : 0;
+			scale_[p] = scale;
+			zero_point_[p] = zero_point;
+		}
+
+	private:
+		void range_check(Index x, Index y) const
+		{
+			if (x < 0 || x >= rows_ || y < 0 || y >= cols_)
+				throw std::out_of_range{ "index is out of range of quantized_matrix" };
+		}
+
+		Index rows_{};
+		Index cols_{};
+		Index ld_{};
+		quantization mode_{ quantization::per_tensor };
+		std::vector<Q, aligned_allocator<Q>> elems_;
+		std::vector<float> scale_;
+		std::vector<std::int32_t> zero_point_;
+	};
+
+	namespace detail
+	{
+		// Scale and zero point mapping [lo, hi] (extended to contain 0, so that zero is exact)
+		// onto the range of Q.
+		template<class Q>
+		void choose_quantization(float lo, float hi, float& scale, std::int32_t& zero_point)
+		{
+			constexpr std::int32_t qmin = quantized_limits<Q>::min;
+			constexpr std::int32_t qmax = quantized_limits<Q>::max;
+
+			lo = std::min(lo, 0.0f);
+			hi = std::max(hi, 0.0f);
+			scale = (hi - lo) / static_cast<float>(qmax - qmin);
+			if (!(scale > 0.0f))
+			{
+				scale = 1.0f;
+				zero_point = std::clamp<std::int32_t>(0, qmin, qmax);
+				return;
+			}
+			const float zp = static_cast<float>(qmin) - lo / scale;
+			zero_point = std::clamp(static_cast<std::int32_t>(std::lround(zp)), qmin, qmax);
+		}
+
+		template<class Q>
+		void quantize_row(const float* src, Index n, float scale, std::int32_t zero_point, Q* dst)
+		{
+			const float inv = 1.0f / scale;
+			for (Index j = 0; j < n; ++j)
+			{
+				// Clamped in float first: converting an out-of-range float to int is undefined.
+				const float q = std::nearbyint(src[j] * inv) + static_cast<float>(zero_point);
+				const float c = std::clamp(q, static_cast<float>(quantized_limits<Q>::min), static_cast<float>(quantized_limits<Q>::max));
+				dst[j] = static_cast<Q>(static_cast<std::int32_t>(c));
+			}
+		}
+
+		inline std::int32_t dot_portable(const std::int8_t* a, const std::int8_t* b, Index n)
+		{
+			std::int32_t s = 0;
+			for (Index k = 0; k < n; ++k)
+				s += static_cast<std::int32_t>(a[k]) * static_cast<std::int32_t>(b[k]);
+			return s;
+		}
+		inline std::int32_t dot_portable(const std::uint8_t* a, const std::int8_t* b, Index n)
+		{
+			std::int32_t s = 0;
+			for (Index k = 0; k < n; ++k)
+				s += static_cast<std::int32_t>(a[k]) * static_cast<std::int32_t>(b[k]);
+			return s;
+		}
+
+#if defined(__AVX2__)
+		inline std::int32_t hsum256(__m256i v)
+		{
+			__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_cvtsi128_si32(s);
+		}
+#endif
+
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+		// The halves are summed explicitly: with GCC 12, _mm512_reduce_add_epi32 and the
+		// unmasked extracts (castsi512_si256 included) start from _mm256_undefined and trip
+		// -Wmaybe-uninitialized, so the zero-masked forms with a full mask are used.
+		inline std::int32_t hsum512(__m512i v)
+		{
+			const __m256i lo = _mm512_maskz_extracti64x4_epi64(0xFF, v, 0);
+			const __m256i hi = _mm512_maskz_extracti64x4_epi64(0xFF, v, 1);
+			return hsum256(_mm256_add_epi32(lo, hi));
+		}
+
+		// vpdpbusd multiplies unsigned by signed bytes and accumulates to int32 without
+		// intermediate saturation. Signed A is turned into |a| and the sign moved onto b,
+		// which is exact in the symmetric int8 range.
+		inline std::int32_t dot_padded(const std::uint8_t* a, const std::int8_t* b, Index n)
+		{
+			__m512i acc = _mm512_setzero_si512();
+			for (Index k = 0; k < n; k += 64)
+				acc = _mm512_dpbusd_epi32(acc, _mm512_load_si512(a + k), _mm512_load_si512(b + k));
+			return hsum512(acc);
+		}
+		inline std::int32_t dot_padded(const std::int8_t* a, const std::int8_t* b, Index n)
+		{
+			__m512i acc = _mm512_setzero_si512();
+			for (Index k = 0; k < n; k += 64)
+			{
+				const __m512i va = _mm512_load_si512(a + k);
+				const __m512i vb = _mm512_load_si512(b + k);
+				const __mmask64 neg = _mm512_movepi8_mask(va);
+				const __m512i abs_a = _mm512_abs_epi8(va);
+				const __m512i sgn_b = _mm512_mask_sub_epi8(vb, neg, _mm512_setzero_si512(), vb);
+				acc = _mm512_dpbusd_epi32(acc, abs_a, sgn_b);
+			}
+			return hsum512(acc);
+		}
+#elif defined(__AVX2__)
+		// pmaddubsw on |a| and b * sign(a): pair sums are at most 2 * 127 * 127, so they
+		// never saturate; pmaddwd with ones widens them to int32.
+		inline std::int32_t dot_padded(const std::int8_t* a, const std::int8_t* b, Index n)
+		{
+			const __m256i ones = _mm256_set1_epi16(1);
+			__m256i acc = _mm256_setzero_si256();
+			for (Index k = 0; k < n; k += 32)
+			{
+				const __m256i va = _mm256_load_si256(reinterpret_cast<const __m256i*>(a + k));
+				const __m256i vb = _mm256_load_si256(reinterpret_cast<const __m256i*>(b + k));
+				const __m256i pairs = _mm256_maddubs_epi16(_mm256_sign_epi8(va, va), _mm256_sign_epi8(vb, va));
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, ones));
+			}
+			return hsum256(acc);
+		}
+		// uint8 * int8 pair sums could saturate pmaddubsw (2 * 255 * 127), so bytes are
+		// widened to 16 bits and multiplied with pmaddwd instead.
+		inline std::int32_t dot_padded(const std::uint8_t* a, const std::int8_t* b, Index n)
+		{
+			__m256i acc = _mm256_setzero_si256();
+			for (Index k = 0; k < n; k += 16)
+			{
+				const __m256i va = _mm256_cvtepu8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(a + k)));
+				const __m256i vb = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(b + k)));
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+			}
+			return hsum256(acc);
+		}
+#else
+		template<class QA>
+		std::int32_t dot_padded(const QA* a, const std::int8_t* b, Index n) { return dot_portable(a, b, n); }
+#endif
+
+		// Rows of B^T processed against every row of A before moving on, sized to stay in L2.
+		constexpr Index quantized_block_n = 64;
+	}
+
+	template<class Q, class A>
+	quantized_matrix<Q> quantize(const matrix<float, A>& mtx, quantization mode = quantization::per_tensor)
+	{
+		const Index rows = mtx.count_rows();
+		const Index cols = mtx.count_cols();
+		quantized_matrix<Q> result(rows, cols, mode);
+
+		// A single infinity would make the scale infinite and a NaN has no quantized value,
+		// so both are rejected rather than silently mapped to the zero point.
+		auto row_range = [&](Index i) {
+			const float* r = mtx.data()[i];
+			float lo = cols ? r[0] : 0.0f;
+			float hi = lo;
+			for (Index j = 0; j < cols; ++j)
+			{
+				if (!std::isfinite(r[j]))
+					throw std::domain_error{ "cannot quantize a matrix with infinite or NaN values" };
+				lo = std::min(lo, r[j]);
+				hi = std::max(hi, r[j]);
+			}
+			return std::make_pair(lo, hi);
+		};
+
+		if (mode == quantization::per_tensor)
+		{
+			float lo = 0.0f;
+			float hi = 0.0f;
+			for (Index i = 0; i < rows; ++i)
+			{
+				const auto rr = row_range(i);
+				lo = std::min(lo, rr.first);
+				hi = std::max(hi, rr.second);
+			}
+			float scale;
+			std::int32_t zp;
+			detail::choose_quantization<Q>(lo, hi, scale, zp);
+			result.set_parameters(0, scale, zp);
+		}
+
+		parallel_for(0, rows, 64, [&](Index first, Index last) {
+			for (Index i = first; i < last; ++i)
+			{
+				if (mode == quantization::per_row)
+				{
+					const auto rr = row_range(i);
+					float scale;
+					std::int32_t zp;
+					detail::choose_quantization<Q>(rr.first, rr.second, scale, zp);
+					result.set_parameters(i, scale, zp);
+				}
+				detail::quantize_row(mtx.data()[i], cols, result.scale(i), result.zero_point(i), result.row(i));
+			}
+		});
+
+		return result;
+	}
+
+	template<class Q>
+	matrix<float> dequantize(const quantized_matrix<Q>& q)
+	{
+		matrix<float> result(q.count_rows(), q.count_cols());
+		for (Index i = 0; i < q.count_rows(); ++i)
+		{
+			const float scale = q.scale(i);
+			const std::int32_t zp = q.zero_point(i);
+			const Q* src = q.row(i);
+			float* dst = result.data()[i];
+			for (Index j = 0; j < q.count_cols(); ++j)
+				dst[j] = scale * static_cast<float>(static_cast<std::int32_t>(src[j]) - zp);
+		}
+		return result;
+	}
+
+	// Integer product of A (m x k) and B given transposed as b_t (n x k, one row per output
+	// column, as weights are usually stored): returns the m x n int32 sums
+	//     sum_k (a[i][k] - za_i) * (b_t[j][k] - zb_j).
+	// Zero points are applied afterwards from row sums, so the inner kernel is a plain
+	// 8-bit dot product (AVX-512 VNNI, AVX2 pmaddubsw/pmaddwd or portable code, chosen at
+	// compile time). Overflow is impossible for k < 2^31 / (255 * 127).
+	template<class QA>
+	matrix<std::int32_t> quantized_multiply(const quantized_matrix<QA>& a, const quantized_matrix<std::int8_t>& b_t)
+	{
+		if (a.count_cols() != b_t.count_cols())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+
+		const Index m = a.count_rows();
+		const Index n = b_t.count_rows();
+		const Index k = a.count_cols();
+		const Index ld = a.leading_dimension();
+
+		std::vector<std::int32_t> sum_a(m);
+		std::vector<std::int32_t> sum_b(n);
+		for (Index i = 0; i < m; ++i)
+			sum_a[i] = std::accumulate(a.row(i), a.row(i) + k, std::int32_t{ 0 });
+		for (Index j = 0; j < n; ++j)
+			sum_b[j] = std::accumulate(b_t.row(j), b_t.row(j) + k, std::int32_t{ 0 });
+
+		matrix<std::int32_t> result(m, n);
+		std::int32_t* const* c = result.data();
+
+		parallel_for(0, m, 16, [&](Index first, Index last) {
+			for (Index jj = 0; jj < n; jj += detail::quantized_block_n)
+			{
+				const Index j_end = std::min(jj + detail::quantized_block_n, n);
+				for (Index i = first; i < last; ++i)
+				{
+					const QA* a_row = a.row(i);
+					const std::int32_t za = a.zero_point(i);
+					for (Index j = jj; j < j_end; ++j)
+					{
+						const std::int32_t zb = b_t.zero_point(j);
+						const std::int32_t raw = detail::dot_padded(a_row, b_t.row(j), ld);
+						c[i][j] = raw - zb * sum_a[i] - za * sum_b[j] + k * za * zb;
+					}
+				}
+			}
+		});
+
+		return result;
+	}
+
+	// quantized_multiply followed by rescaling with the scales of both operands.
+	template<class QA>
+	matrix<float> quantized_multiply_dequantize(const quantized_matrix<QA>& a, const quantized_matrix<std::int8_t>& b_t)
+	{
+		const auto acc = quantized_multiply(a, b_t);
+		matrix<float> result(acc.count_rows(), acc.count_cols());
+		for (Index i = 0; i < acc.count_rows(); ++i)
+			for (Index j = 0; j < acc.count_cols(); ++j)
+				result.data()[i][j] = a.scale(i) * b_t.scale(j) * static_cast<float>(acc.data()[i][j]);
+		return result;
+	}
+}
+
+#endif // QUANTIZED_MATRIX_HPP
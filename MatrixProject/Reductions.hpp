@@ -0,0 +1,784 @@
+#pragma once
+#ifndef REDUCTIONS_HPP
+#define REDUCTIONS_HPP
+
+#include<cmath>
+#include<vector>
+#include<limits>
+#include<cstdint>
+#include<stdexcept>
+#include<algorithm>
+#include<type_traits>
+#include<functional>
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Gemv.hpp"
+
+namespace my
+{
+	// Summation algorithm used by sum, mean, variance and the norms.
+	//   naive:    plain accumulation (in several independent lanes so it vectorizes);
+	//   kahan:    compensated summation, error independent of the number of terms,
+	//             roughly twice as expensive. Defeated by -ffast-math / /fp:fast;
+	//   pairwise: recursive halving, error grows as log(n), almost as fast as naive.
+	enum class summation { naive, kahan, pairwise };
+
+	enum class norm_type { l1, l2, frobenius, infinity };
+
+	// Result of minimum/maximum of a whole matrix. The extrema skip NaN values: the result
+	// is NaN (at the first position) only if every value is NaN.
+	template<class T>
+	struct extremum
+	{
+		T value{};
+		Index row{};
+		Index col{};
+	};
+
+	// Result of per-row or per-column minimum/maximum: 'index' is the column (for rows) or
+	// the row (for columns) of the first occurrence.
+	template<class T>
+	struct indexed_value
+	{
+		T value{};
+		Index index{};
+	};
+
+	namespace detail
+	{
+		constexpr Index reduce_lanes = 8;
+		constexpr Index pairwise_block = 128;
+		// minimal number of elements handed to one thread
+		constexpr Index reduce_grain = Index(1) << 15;
+
+		inline Index reduce_row_grain(Index cols) { return std::max<Index>(1, reduce_grain / std::max<Index>(cols, 1)); }
+
+		struct identity_op
+		{
+			template<class T>
+			T operator()(const T& x) const { return x; }
+		};
+		struct abs_op
+		{
+			template<class T>
+			T operator()(const T& x) const { return x < T{} ? -x : x; }
+		};
+		struct square_op
+		{
+			template<class T>
+			T operator()(const T& x) const { return x * x; }
+		};
+		template<class T>
+		struct deviation_op
+		{
+			T mean{};
+			T operator()(const T& x) const { const T d = x - mean; return d * d; }
+		};
+
+		template<class T, class F>
+		T naive_sum(const T* p, Index n, F f)
+		{
+			T acc[reduce_lanes]{};
+			Index i = 0;
+			for (; i + reduce_lanes <= n; i += reduce_lanes)
+				for (Index l = 0; l < reduce_lanes; ++l)
+					acc[l] += f(p[i + l]);
+
+			T s{};
+			for (Index l = 0; l < reduce_lanes; ++l)
+				s += acc[l];
+			for (; i < n; ++i)
+				s += f(p[i]);
+			return s;
+		}
+
+		template<class T>
+		void kahan_add(T& s, T& c, const T& x)
+		{
+			const T y = x - c;
+			const T t = s + y;
+			c = (t - s) - y;
+			s = t;
+		}
+
+		template<class T, class F>
+		T kahan_sum(const T* p, Index n, F f)
+		{
+			T s[reduce_lanes]{};
+			T c[reduce_lanes]{};
+			Index i = 0;
+			for (; i + reduce_lanes <= n; i += reduce_lanes)
+				for (Index l = 0; l < reduce_lanes; ++l)
+					kahan_add(s[l], c[l], f(p[i + l]));
+
+			T total{};
+			T comp{};
+			for (Index l = 0; l < reduce_lanes; ++l)
+			{
+				kahan_add(total, comp, s[l]);
+				kahan_add(total, comp, -c[l]);
+			}
+			for (; i < n; ++i)
+				kahan_add(total, comp, f(p[i]));
+			return total;
+		}
+
+		template<class T, class F>
+		T pairwise_sum(const T* p, Index n, F f)
+		{
+			if (n <= pairwise_block)
+				return naive_sum(p, n, f);
+
+			const Index h = n / 2 / reduce_lanes * reduce_lanes;
+			return pairwise_sum(p, h, f) + pairwise_sum(p + h, n - h, f);
+		}
+
+		template<class T, class F>
+		T sum_span(const T* p, Index n, summation s, F f)
+		{
+			switch (s)
+			{
+			case summation::kahan: return kahan_sum(p, n, f);
+			case summation::pairwise: return pairwise_sum(p, n, f);
+			default: return naive_sum(p, n, f);
+			}
+		}
+
+		template<class T, class F>
+		T product_span(const T* p, Index n, F f)
+		{
+			T acc[reduce_lanes];
+			std::fill(acc, acc + reduce_lanes, T{ 1 });
+			Index i = 0;
+			for (; i + reduce_lanes <= n; i += reduce_lanes)
+				for (Index l = 0; l < reduce_lanes; ++l)
+					acc[l] *= f(p[i + l]);
+
+			T r{ 1 };
+			for (Index l = 0; l < reduce_lanes; ++l)
+				r *= acc[l];
+			for (; i < n; ++i)
+				r *= f(p[i]);
+			return r;
+		}
+
+		// False for every value of a type without NaN.
+		template<class T>
+		bool is_nan_value(const T& x) { return !(x == x); }
+
+		// Whether x replaces cur as the extremum: it is better, or cur is NaN and x is not.
+		template<class T, class Less>
+		bool extremum_better(const T& x, const T& cur, Less less)
+		{
+			return less(x, cur) || (is_nan_value(cur) && !is_nan_value(x));
+		}
+
+		// Minimum (Less = std::less) or maximum (Less = std::greater) of a span: the value is
+		// found with a vectorizable lane loop, its position with a second linear search. The
+		// lanes start from the first value that is not NaN, so NaN values never win (a
+		// comparison with NaN is false).
+		template<class T, class Less>
+		indexed_value<T> extremum_span(const T* p, Index n, Less less)
+		{
+			const Index start = static_cast<Index>(std::find_if(p, p + n, [](const T& x) { return !is_nan_value(x); }) - p);
+			if (start == n)
+				return { p[0], 0 };
+
+			T acc[reduce_lanes];
+			std::fill(acc, acc + reduce_lanes, p[start]);
+			Index i = start;
+			for (; i + reduce_lanes <= n; i += reduce_lanes)
+				for (Index l = 0; l < reduce_lanes; ++l)
+					acc[l] = less(p[i + l], acc[l]) ? p[i + l] : acc[l];
+
+			T best = acc[0];
+			for (Index l = 1; l < reduce_lanes; ++l)
+				best = less(acc[l], best) ? acc[l] : best;
+			for (; i < n; ++i)
+				best = less(p[i], best) ? p[i] : best;
+
+			return { best, static_cast<Index>(std::find(p + start, p + n, best) - p) };
+		}
+
+		// f(row) for every row, rows are distributed among threads.
+		template<class T, class A, class R, class F>
+		std::vector<R> per_row(const matrix<T, A>& mtx, F f)
+		{
+			std::vector<R> result(mtx.count_rows());
+			const T* const* rows = mtx.data();
+			parallel_for(0, mtx.count_rows(), reduce_row_grain(mtx.count_cols()), [&](Index first, Index last) {
+				for (Index i = first; i < last; ++i)
+					result[i] = f(rows[i]);
+			});
+			return result;
+		}
+
+		// Per-column reduction over all rows: the rows are split into one contiguous band
+		// per thread, band(first, last, out) reduces rows [first, last) into 'out' (cols
+		// values, all 'init' at first), and merge(out, partial) folds the band results into
+		// the first one in row order. The inner loops run along rows and vectorize.
+		template<class R, class T, class A, class Band, class Merge>
+		std::vector<R> column_bands(const matrix<T, A>& mtx, const R& init, Band band, Merge merge)
+		{
+			const Index rows = mtx.count_rows();
+			const Index cols = mtx.count_cols();
+			const Index grain = reduce_row_grain(cols);
+			const Index bands = std::max<Index>(1, std::min<Index>(hardware_threads(), (rows + grain - 1) / grain));
+			std::vector<std::vector<R>> partial(bands, std::vector<R>(cols, init));
+
+			parallel_for(0, bands, 1, [&](Index first, Index last) {
+				for (Index b = first; b < last; ++b)
+					band(chunk_offset(rows, b, bands), chunk_offset(rows, b + 1, bands), partial[b].data());
+			});
+
+			for (Index b = 1; b < bands; ++b)
+				merge(partial[0].data(), partial[b].data());
+			return std::move(partial[0]);
+		}
+
+		// Sum over rows of f(x, col) for every column, see column_bands.
+		template<class T, class A, class F>
+		std::vector<T> column_sums(const matrix<T, A>& mtx, summation s, F f)
+		{
+			const Index cols = mtx.count_cols();
+			const T* const* data = mtx.data();
+
+			auto band_naive = [&](Index first, Index last, T* out) {
+				for (Index i = first; i < last; ++i)
+				{
+					const T* r = data[i];
+					for (Index j = 0; j < cols; ++j)
+						out[j] += f(r[j], j);
+				}
+			};
+			auto band = [&](Index first, Index last, T* out, auto& self) -> void {
+				if (s == summation::pairwise && last - first > pairwise_block)
+				{
+					const Index mid = first + (last - first) / 2;
+					std::vector<T> upper(cols);
+					self(first, mid, out, self);
+					self(mid, last, upper.data(), self);
+					for (Index j = 0; j < cols; ++j)
+						out[j] += upper[j];
+				}
+				else if (s == summation::kahan)
+				{
+					std::vector<T> comp(cols);
+					for (Index i = first; i < last; ++i)
+					{
+						const T* r = data[i];
+						for (Index j = 0; j < cols; ++j)
+							kahan_add(out[j], comp[j], f(r[j], j));
+					}
+				}
+				else
+				{
+					band_naive(first, last, out);
+				}
+			};
+
+			std::vector<T> comp(cols);
+			return column_bands<T>(mtx, T{},
+				[&](Index first, Index last, T* out) { band(first, last, out, band); },
+				[&](T* out, const T* p) {
+					for (Index j = 0; j < cols; ++j)
+					{
+						if (s == summation::kahan)
+							kahan_add(out[j], comp[j], p[j]);
+						else
+							out[j] += p[j];
+					}
+				});
+		}
+
+		template<class T, class A, class F>
+		T total_sum(const matrix<T, A>& mtx, summation s, F f)
+		{
+			const Index cols = mtx.count_cols();
+			auto partial = per_row<T, A, T>(mtx, [&](const T* r) { return sum_span(r, cols, s, f); });
+			return sum_span(partial.data(), static_cast<Index>(partial.size()), s, identity_op{});
+		}
+
+		// In 64 bits: rows * cols can overflow a 32-bit Index (MY_MATRIX_INDEX_32).
+		template<class T, class A>
+		std::int64_t element_count(const matrix<T, A>& mtx)
+		{
+			return static_cast<std::int64_t>(mtx.count_rows()) * mtx.count_cols();
+		}
+
+		inline void empty_check(std::int64_t n)
+		{
+			if (n == 0)
+				throw std::length_error{ "reduction of an empty matrix" };
+		}
+
+		template<class T, class Less, class A>
+		extremum<T> matrix_extremum(const matrix<T, A>& mtx, Less less)
+		{
+			empty_check(element_count(mtx));
+			const Index cols = mtx.count_cols();
+			auto rows = per_row<T, A, indexed_value<T>>(mtx, [&](const T* r) { return extremum_span(r, cols, less); });
+
+			extremum<T> best{ rows[0].value, 0, rows[0].index };
+			for (Index i = 1; i < static_cast<Index>(rows.size()); ++i)
+				if (extremum_better(rows[i].value, best.value, less))
+					best = { rows[i].value, i, rows[i].index };
+			return best;
+		}
+
+		template<class T, class Less, class A>
+		std::vector<indexed_value<T>> column_extremum(const matrix<T, A>& mtx, Less less)
+		{
+			empty_check(mtx.count_rows());
+			const Index cols = mtx.count_cols();
+			const T* const* data = mtx.data();
+
+			// bands are merged in row order and only a strictly better value replaces the
+			// current one, so the first occurrence wins as in a serial scan
+			return column_bands<indexed_value<T>>(mtx, indexed_value<T>{},
+				[&](Index first, Index last, indexed_value<T>* out) {
+					for (Index j = 0; j < cols; ++j)
+						out[j] = { data[first][j], first };
+					for (Index i = first + 1; i < last; ++i)
+					{
+						const T* r = data[i];
+						for (Index j = 0; j < cols; ++j)
+						{
+							const bool sel = extremum_better(r[j], out[j].value, less);
+							out[j].value = sel ? r[j] : out[j].value;
+							out[j].index = sel ? i : out[j].index;
+						}
+					}
+				},
+				[&](indexed_value<T>* out, const indexed_value<T>* p) {
+					for (Index j = 0; j < cols; ++j)
+						if (extremum_better(p[j].value, out[j].value, less))
+							out[j] = p[j];
+				});
+		}
+
+		template<class T>
+		void floating_point_check()
+		{
+			static_assert(std::is_floating_point_v<T>, "this reduction requires a floating point element type");
+		}
+	}
+
+	// ---------------- whole matrix ----------------
+
+	template<class T, class A>
+	T sum(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		return detail::total_sum(mtx, s, detail::identity_op{});
+	}
+
+	template<class T, class A>
+	T product(const matrix<T, A>& mtx)
+	{
+		const Index cols = mtx.count_cols();
+		auto partial = detail::per_row<T, A, T>(mtx, [&](const T* r) { return detail::product_span(r, cols, detail::identity_op{}); });
+		return detail::product_span(partial.data(), static_cast<Index>(partial.size()), detail::identity_op{});
+	}
+
+	template<class T, class A>
+	extremum<T> minimum(const matrix<T, A>& mtx) { return detail::matrix_extremum(mtx, std::less<T>{}); }
+
+	template<class T, class A>
+	extremum<T> maximum(const matrix<T, A>& mtx) { return detail::matrix_extremum(mtx, std::greater<T>{}); }
+
+	template<class T, class A>
+	T mean(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		detail::floating_point_check<T>();
+		detail::empty_check(detail::element_count(mtx));
+		return sum(mtx, s) / static_cast<T>(detail::element_count(mtx));
+	}
+
+	// Population variance, computed in two passes (mean, then squared deviations).
+	template<class T, class A>
+	T variance(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		const T m = mean(mtx, s);
+		return detail::total_sum(mtx, s, detail::deviation_op<T>{ m }) / static_cast<T>(detail::element_count(mtx));
+	}
+
+	// Result of spectral_norm.
+	template<class T>
+	struct spectral_norm_estimate
+	{
+		T value{};
+		int iterations{};
+		bool converged{ false };
+	};
+
+	namespace detail
+	{
+		// Lanczos steps between restarts of spectral_norm.
+		constexpr Index lanczos_steps = 32;
+
+		// Largest eigenvalue of the symmetric tridiagonal matrix with diagonal d[0..k) and
+		// off-diagonal e[0..k-1), by bisection on Sturm counts within the Gershgorin bounds.
+		template<class T>
+		T tridiagonal_max_eigenvalue(const T* d, const T* e, Index k)
+		{
+			T lo = d[0];
+			T hi = d[0];
+			for (Index i = 0; i < k; ++i)
+			{
+				const T r = (i > 0 ? std::abs(e[i - 1]) : T{}) + (i + 1 < k ? std::abs(e[i]) : T{});
+				lo = std::min(lo, d[i] - r);
+				hi = std::max(hi, d[i] + r);
+			}
+
+			// number of eigenvalues below x
+			auto count_below = [&](T x) {
+				Index c = 0;
+				T q{ 1 };
+				for (Index i = 0; i < k; ++i)
+				{
+					q = d[i] - x - (i > 0 ? e[i - 1] * e[i - 1] / q : T{});
+					if (q == T{})
+						q = -std::numeric_limits<T>::epsilon() * (std::abs(x) + std::numeric_limits<T>::min());
+					if (q < T{}) ++c;
+				}
+				return c;
+			};
+
+			const T eps = std::numeric_limits<T>::epsilon();
+			for (int it = 0; it < 256 && hi - lo > eps * std::max(std::abs(lo), std::abs(hi)); ++it)
+			{
+				const T mid = lo + (hi - lo) / T{ 2 };
+				if (mid <= lo || mid >= hi) break;
+				if (count_below(mid) == k)
+					hi = mid;
+				else
+					lo = mid;
+			}
+			return hi;
+		}
+
+		// Unit eigenvector y of that matrix for the eigenvalue lambda, by two steps of inverse
+		// iteration with a dense, partially pivoted elimination (k is at most lanczos_steps).
+		template<class T>
+		void tridiagonal_eigenvector(const T* d, const T* e, Index k, T lambda, T* y)
+		{
+			const T tiny = std::numeric_limits<T>::epsilon() * std::max(std::abs(lambda), std::numeric_limits<T>::min());
+			std::vector<T> m(static_cast<std::size_t>(k) * k);
+			std::fill(y, y + k, T{ 1 });
+
+			for (int pass = 0; pass < 2; ++pass)
+			{
+				std::fill(m.begin(), m.end(), T{});
+				for (Index i = 0; i < k; ++i)
+				{
+					m[i * k + i] = d[i] - lambda;
+					if (i + 1 < k)
+						m[i * k + i + 1] = m[(i + 1) * k + i] = e[i];
+				}
+
+				for (Index c = 0; c < k; ++c)
+				{
+					Index piv = c;
+					for (Index r = c + 1; r < k; ++r)
+						if (std::abs(m[r * k + c]) > std::abs(m[piv * k + c])) piv = r;
+					if (piv != c)
+					{
+						std::swap_ranges(m.begin() + c * k, m.begin() + (c + 1) * k, m.begin() + piv * k);
+						std::swap(y[c], y[piv]);
+					}
+					if (std::abs(m[c * k + c]) < tiny)
+						m[c * k + c] = tiny;
+					for (Index r = c + 1; r < k; ++r)
+					{
+						const T f = m[r * k + c] / m[c * k + c];
+						if (f == T{}) continue;
+						for (Index j = c; j < k; ++j)
+							m[r * k + j] -= f * m[c * k + j];
+						y[r] -= f * y[c];
+					}
+				}
+				for (Index c = k; c-- > 0;)
+				{
+					T x = y[c];
+					for (Index j = c + 1; j < k; ++j)
+						x -= m[c * k + j] * y[j];
+					y[c] = x / m[c * k + c];
+				}
+
+				const T yn = std::sqrt(naive_sum(y, k, square_op{}));
+				for (Index i = 0; i < k; ++i)
+					y[i] /= yn;
+			}
+		}
+	}
+
+	// Spectral norm (largest singular value) by the Lanczos method on A^T * A with full
+	// reorthogonalization, restarted from the Ritz vector every lanczos_steps steps. Both
+	// products of a step are parallel gemv calls. Stops when the residual bound on sigma
+	// is at most 'tolerance' relative to it, else after max_iterations steps with converged
+	// false and the current estimate, which never exceeds sigma. A tolerance <= 0 selects
+	// sqrt(epsilon).
+	template<class T, class A>
+	spectral_norm_estimate<T> spectral_norm(const matrix<T, A>& mtx, int max_iterations = 500, T tolerance = T{})
+	{
+		detail::floating_point_check<T>();
+		if (max_iterations < 1)
+			throw std::invalid_argument{ "spectral_norm requires at least one iteration" };
+
+		const Index rows = mtx.count_rows();
+		const Index cols = mtx.count_cols();
+		if (rows == 0 || cols == 0) return { T{}, 0, true };
+		if (!(tolerance > T{}))
+			tolerance = std::sqrt(std::numeric_limits<T>::epsilon());
+		// about the rounding error of the products, relative to sigma^2
+		const T noise = T{ 8 } * std::numeric_limits<T>::epsilon() * std::sqrt(static_cast<T>(std::max(rows, cols)));
+
+		const Index steps = std::min(detail::lanczos_steps, cols);
+		std::vector<T> basis(static_cast<std::size_t>(steps) * cols);
+		auto v = [&](Index j) { return basis.data() + static_cast<std::ptrdiff_t>(j) * cols; };
+		std::vector<T> w(cols);
+		std::vector<T> u(rows);
+		std::vector<T> diag(steps);
+		std::vector<T> off(steps);
+		std::vector<T> y(steps);
+
+		for (Index j = 0; j < cols; ++j)
+			w[j] = T{ 1 } + static_cast<T>(j % 7) / T{ 8 };
+
+		int iter = 0;
+		T theta{};
+		for (;;)
+		{
+			// w holds the start vector (or the Ritz vector of the previous cycle)
+			const T wn = std::sqrt(detail::naive_sum(w.data(), cols, detail::square_op{}));
+			if (wn == T{}) return { T{}, iter, true };
+			for (Index i = 0; i < cols; ++i)
+				v(0)[i] = w[i] / wn;
+
+			for (Index j = 0; j < steps; ++j)
+			{
+				gemv(T{ 1 }, mtx, vector_view<const T>(v(j), cols), T{}, u);
+				gemv_transposed(T{ 1 }, mtx, u, T{}, w);
+				++iter;
+
+				diag[j] = detail::dot(v(j), w.data(), cols);
+				if (std::isnan(diag[j])) return { diag[j], iter, true };
+				// two passes of Gram-Schmidt against the whole basis keep it orthogonal
+				for (int pass = 0; pass < 2; ++pass)
+					for (Index i = 0; i <= j; ++i)
+						detail::axpy(-detail::dot(v(i), w.data(), cols), v(i), w.data(), cols);
+				off[j] = std::sqrt(detail::naive_sum(w.data(), cols, detail::square_op{}));
+
+				theta = detail::tridiagonal_max_eigenvalue(diag.data(), off.data(), j + 1);
+				detail::tridiagonal_eigenvector(diag.data(), off.data(), j + 1, theta, y.data());
+
+				// |theta - sigma^2| <= off * |y_last|; the relative error of sigma^2 is twice
+				// that of sigma
+				const T residual = off[j] * std::abs(y[j]);
+				if (residual <= T{ 2 } * tolerance * theta || off[j] <= noise * theta)
+					return { std::sqrt(theta), iter, true };
+				if (iter >= max_iterations)
+					return { std::sqrt(theta), iter, false };
+
+				if (j + 1 < steps)
+					for (Index i = 0; i < cols; ++i)
+						v(j + 1)[i] = w[i] / off[j];
+			}
+
+			// restart from the Ritz vector
+			std::fill(w.begin(), w.end(), T{});
+			for (Index j = 0; j < steps; ++j)
+				detail::axpy(y[j], v(j), w.data(), cols);
+		}
+	}
+
+	// Matrix norms: l1 is the maximal absolute column sum, infinity the maximal absolute row
+	// sum, frobenius the square root of the sum of squares and l2 the spectral norm (see
+	// spectral_norm, with its default arguments; if that does not converge its estimate is
+	// returned all the same, a lower bound of the norm).
+	template<class T, class A>
+	T norm(const matrix<T, A>& mtx, norm_type type = norm_type::frobenius, summation s = summation::naive)
+	{
+		detail::floating_point_check<T>();
+
+		const Index rows = mtx.count_rows();
+		const Index cols = mtx.count_cols();
+		if (rows == 0 || cols == 0) return T{};
+
+		switch (type)
+		{
+		case norm_type::l1:
+		{
+			auto c = detail::column_sums(mtx, s, [](const T& x, Index) { return std::abs(x); });
+			return *std::max_element(c.begin(), c.end());
+		}
+		case norm_type::infinity:
+		{
+			auto r = detail::per_row<T, A, T>(mtx, [&](const T* p) { return detail::sum_span(p, cols, s, detail::abs_op{}); });
+			return *std::max_element(r.begin(), r.end());
+		}
+		case norm_type::l2:
+		{
+			return spectral_norm(mtx).value;
+		}
+		default:
+			return std::sqrt(detail::total_sum(mtx, s, detail::square_op{}));
+		}
+	}
+
+	// ---------------- per row ----------------
+
+	template<class T, class A>
+	std::vector<T> row_sums(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		const Index cols = mtx.count_cols();
+		return detail::per_row<T, A, T>(mtx, [&](const T* r) { return detail::sum_span(r, cols, s, detail::identity_op{}); });
+	}
+
+	template<class T, class A>
+	std::vector<T> row_products(const matrix<T, A>& mtx)
+	{
+		const Index cols = mtx.count_cols();
+		return detail::per_row<T, A, T>(mtx, [&](const T* r) { return detail::product_span(r, cols, detail::identity_op{}); });
+	}
+
+	template<class T, class A>
+	std::vector<indexed_value<T>> row_minimums(const matrix<T, A>& mtx)
+	{
+		detail::empty_check(mtx.count_cols());
+		const Index cols = mtx.count_cols();
+		return detail::per_row<T, A, indexed_value<T>>(mtx, [&](const T* r) { return detail::extremum_span(r, cols, std::less<T>{}); });
+	}
+
+	template<class T, class A>
+	std::vector<indexed_value<T>> row_maximums(const matrix<T, A>& mtx)
+	{
+		detail::empty_check(mtx.count_cols());
+		const Index cols = mtx.count_cols();
+		return detail::per_row<T, A, indexed_value<T>>(mtx, [&](const T* r) { return detail::extremum_span(r, cols, std::greater<T>{}); });
+	}
+
+	template<class T, class A>
+	std::vector<T> row_means(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		detail::floating_point_check<T>();
+		detail::empty_check(mtx.count_cols());
+		auto r = row_sums(mtx, s);
+		for (auto& x : r) x /= static_cast<T>(mtx.count_cols());
+		return r;
+	}
+
+	template<class T, class A>
+	std::vector<T> row_variances(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		detail::floating_point_check<T>();
+		detail::empty_check(mtx.count_cols());
+		const Index cols = mtx.count_cols();
+		return detail::per_row<T, A, T>(mtx, [&](const T* r) {
+			const T m = detail::sum_span(r, cols, s, detail::identity_op{}) / static_cast<T>(cols);
+			return detail::sum_span(r, cols, s, detail::deviation_op<T>{ m }) / static_cast<T>(cols);
+		});
+	}
+
+	// Vector norms of every row (l2 and frobenius are the same here).
+	template<class T, class A>
+	std::vector<T> row_norms(const matrix<T, A>& mtx, norm_type type = norm_type::l2, summation s = summation::naive)
+	{
+		detail::floating_point_check<T>();
+		const Index cols = mtx.count_cols();
+		return detail::per_row<T, A, T>(mtx, [&](const T* r) {
+			switch (type)
+			{
+			case norm_type::l1: return detail::sum_span(r, cols, s, detail::abs_op{});
+			case norm_type::infinity: return cols == 0 ? T{} : std::abs(detail::extremum_span(r, cols, [](const T& x, const T& y) { return std::abs(x) > std::abs(y); }).value);
+			default: return std::sqrt(detail::sum_span(r, cols, s, detail::square_op{}));
+			}
+		});
+	}
+
+	// ---------------- per column ----------------
+
+	template<class T, class A>
+	std::vector<T> col_sums(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		return detail::column_sums(mtx, s, [](const T& x, Index) { return x; });
+	}
+
+	template<class T, class A>
+	std::vector<T> col_products(const matrix<T, A>& mtx)
+	{
+		const Index cols = mtx.count_cols();
+		const T* const* data = mtx.data();
+		return detail::column_bands<T>(mtx, T{ 1 },
+			[&](Index first, Index last, T* out) {
+				for (Index i = first; i < last; ++i)
+					for (Index j = 0; j < cols; ++j)
+						out[j] *= data[i][j];
+			},
+			[&](T* out, const T* p) {
+				for (Index j = 0; j < cols; ++j)
+					out[j] *= p[j];
+			});
+	}
+
+	template<class T, class A>
+	std::vector<indexed_value<T>> col_minimums(const matrix<T, A>& mtx) { return detail::column_extremum(mtx, std::less<T>{}); }
+
+	template<class T, class A>
+	std::vector<indexed_value<T>> col_maximums(const matrix<T, A>& mtx) { return detail::column_extremum(mtx, std::greater<T>{}); }
+
+	template<class T, class A>
+	std::vector<T> col_means(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		detail::floating_point_check<T>();
+		detail::empty_check(mtx.count_rows());
+		auto c = col_sums(mtx, s);
+		for (auto& x : c) x /= static_cast<T>(mtx.count_rows());
+		return c;
+	}
+
+	template<class T, class A>
+	std::vector<T> col_variances(const matrix<T, A>& mtx, summation s = summation::naive)
+	{
+		const auto m = col_means(mtx, s);
+		auto c = detail::column_sums(mtx, s, [&m](const T& x, Index j) { const T d = x - m[j]; return d * d; });
+		for (auto& x : c) x /= static_cast<T>(mtx.count_rows());
+		return c;
+	}
+
+	// Vector norms of every column (l2 and frobenius are the same here).
+	template<class T, class A>
+	std::vector<T> col_norms(const matrix<T, A>& mtx, norm_type type = norm_type::l2, summation s = summation::naive)
+	{
+		detail::floating_point_check<T>();
+		switch (type)
+		{
+		case norm_type::l1:
+			return detail::column_sums(mtx, s, [](const T& x, Index) { return std::abs(x); });
+		case norm_type::infinity:
+		{
+			const Index cols = mtx.count_cols();
+			const T* const* data = mtx.data();
+			return detail::column_bands<T>(mtx, T{},
+				[&](Index first, Index last, T* out) {
+					for (Index i = first; i < last; ++i)
+						for (Index j = 0; j < cols; ++j)
+							out[j] = std::max(out[j], std::abs(data[i][j]));
+				},
+				[&](T* out, const T* p) {
+					for (Index j = 0; j < cols; ++j)
+						out[j] = std::max(out[j], p[j]);
+				});
+		}
+		default:
+		{
+			auto c = detail::column_sums(mtx, s, [](const T& x, Index) { return x * x; });
+			for (auto& x : c) x = std::sqrt(x);
+			return c;
+		}
+		}
+	}
+}
+
+#endif // REDUCTIONS_HPP
@@ -0,0 +1,268 @@
+#pragma once
+#ifndef RING_MATRIX_HPP
+#define RING_MATRIX_HPP
+
+#include<memory>
+#include<vector>
+#include<cstddef>
+#include<iterator>
+#include<stdexcept>
+#include<algorithm>
+
+#include"Matrix.hpp"
+
+namespace my
+{
+	// Matrix with a fixed number of columns whose rows form a circular buffer, for sliding
+	// windows: push_back_row and pop_front_row are O(1) and a popped row buffer is reused
+	// by a later push instead of being freed. Row i is the i-th oldest row. The row table
+	// only grows (by doubling) when more rows are pushed than have ever been popped, so a
+	// window of steady size does not allocate at all.
+	template<class T, class A = std::allocator<T>>
+	class ring_matrix
+	{
+		template<class Ptr, class Owner>
+		class basic_row_iterator
+		{
+		public:
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = Ptr;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const Ptr*;
+			using reference = Ptr;
+
+			basic_row_iterator() {}
+			basic_row_iterator(Owner* owner, Index i) : owner{ owner }, i{ i } {}
+
+			Ptr operator*() const { return owner->row_unchecked(i); }
+			Ptr operator[](difference_type n) const { return owner->row_unchecked(i + static_cast<Index>(n)); }
+
+			basic_row_iterator& operator++() { ++i; return *this; }
+			basic_row_iterator operator++(int) { auto tmp = *this; ++i; return tmp; }
+			basic_row_iterator& operator--() { --i; return *this; }
+			basic_row_iterator operator--(int) { auto tmp = *this; --i; return tmp; }
+
+			basic_row_iterator& operator+=(difference_type n) { i += static_cast<Index>(n); return *this; }
+			basic_row_iterator& operator-=(difference_type n) { i -= static_cast<Index>(n); return *this; }
+			basic_row_iterator operator+(difference_type n) const { return { owner, i + static_cast<Index>(n) }; }
+			basic_row_iterator operator-(difference_type n) const { return { owner, i - static_cast<Index>(n) }; }
+			friend basic_row_iterator operator+(difference_type n, const basic_row_iterator& it) { return it + n; }
+			difference_type operator-(const basic_row_iterator& other) const { return i - other.i; }
+
+			bool operator==(const basic_row_iterator& other) const { return i == other.i; }
+			bool operator!=(const basic_row_iterator& other) const { return i != other.i; }
+			bool operator<(const basic_row_iterator& other) const { return i < other.i; }
+			bool operator>(const basic_row_iterator& other) const { return i > other.i; }
+			bool operator<=(const basic_row_iterator& other) const { return i <= other.i; }
+			bool operator>=(const basic_row_iterator& other) const { return i >= other.i; }
+
+		private:
+			Owner* owner{};
+			Index i{};
+		};
+
+	public:
+		using allocator_type = A;
+		using size_type = Index;
+		using value_type = T;
+		// Iterators over the rows in logical order; they dereference to row pointers.
+		using iterator = basic_row_iterator<T*, ring_matrix>;
+		using const_iterator = basic_row_iterator<const T*, const ring_matrix>;
+
+		explicit ring_matrix(Index cols, Index capacity_rows = 0, const allocator_type& al = allocator_type())
+			: cols{ cols }, alloc{ al }
+		{
+			if (cols < 0 || capacity_rows < 0)
+				throw std::invalid_argument{ "matrix_size arguments must be positive" };
+			reserve_rows(capacity_rows);
+		}
+
+		ring_matrix(const ring_matrix& other) : cols{ other.cols }, alloc{ other.alloc }
+		{
+			// the destructor does not run if a copy throws, so free the rows copied so far
+			try {
+				reserve_rows(other.count);
+				for (Index i = 0; i < other.count; ++i)
+					push_back_row(other.row_unchecked(i), other.row_unchecked(i) + cols);
+			}
+			catch (...) {
+				release();
+				throw;
+			}
+		}
+		ring_matrix(ring_matrix&& other) noexcept : cols{ other.cols }, alloc{ other.alloc } { swap(other); }
+		ring_matrix& operator=(ring_matrix other) noexcept
+		{
+			swap(other);
+			return *this;
+		}
+
+		~ring_matrix() { release(); }
+
+		Index count_rows() const { return count; }
+		Index count_cols() const { return cols; }
+		Index capacity_rows() const { return static_cast<Index>(table.size()); }
+		bool empty() const { return count == 0; }
+
+		void reserve_rows(Index newalloc)
+		{
+			if (newalloc <= capacity_rows()) return;
+
+			// unroll the ring so that row 0 is in slot 0; buffers of free slots move along
+			std::vector<T*> grown(newalloc, nullptr);
+			std::rotate_copy(table.begin(), table.begin() + head, table.end(), grown.begin());
+			table.swap(grown);
+			head = 0;
+		}
+
+		T* row(Index x)
+		{
+			range_check(x, count);
+			return row_unchecked(x);
+		}
+		const T* row(Index x) const
+		{
+			range_check(x, count);
+			return row_unchecked(x);
+		}
+		T* operator[](Index x) { return row(x); }
+		const T* operator[](Index x) const { return row(x); }
+
+		T& at(Index x, Index y)
+		{
+			range_check(y, cols);
+			return row(x)[y];
+		}
+		const T& at(Index x, Index y) const
+		{
+			range_check(y, cols);
+			return row(x)[y];
+		}
+
+		T* front_row() { return row(0); }
+		const T* front_row() const { return row(0); }
+		T* back_row() { return row(count - 1); }
+		const T* back_row() const { return row(count - 1); }
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, count); }
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, count); }
+		const_iterator cbegin() const { return begin(); }
+		const_iterator cend() const { return end(); }
+
+		template<class It>
+		void push_back_row(It first, It last)
+		{
+			if (std::distance(first, last) != cols)
+				throw std::out_of_range{ "columns count is not equal to new row" };
+
+			if (count == capacity_rows())
+				reserve_rows(std::max<Index>(1, 2 * count));
+
+			T*& slot = table[physical(count)];
+			if (slot == nullptr && cols > 0)
+				slot = elem_traits::allocate(alloc, cols);
+
+			Index j = 0;
+			try {
+				for (; j < cols; ++j, ++first)
+					elem_traits::construct(alloc, slot + j, *first);
+			}
+			catch (...) {
+				destroy_elems(slot, j);
+				throw;
+			}
+			++count;
+		}
+		template<class Container>
+		void push_back_row(const Container& cont) { push_back_row(std::cbegin(cont), std::cend(cont)); }
+
+		// Drops the oldest row; its buffer is kept for the next push.
+		void pop_front_row()
+		{
+			if (count == 0)
+				throw std::out_of_range{ "pop_front_row on empty ring_matrix" };
+
+			destroy_elems(table[head], cols);
+			head = (head + 1 == capacity_rows()) ? 0 : head + 1;
+			--count;
+		}
+		void pop_back_row()
+		{
+			if (count == 0)
+				throw std::out_of_range{ "pop_back_row on empty ring_matrix" };
+
+			destroy_elems(table[physical(count - 1)], cols);
+			--count;
+		}
+
+		void clear()
+		{
+			while (count > 0)
+				pop_back_row();
+			head = 0;
+		}
+
+		template<class MA = A>
+		matrix<T, MA> to_matrix() const
+		{
+			matrix<T, MA> result(count, cols);
+			for (Index i = 0; i < count; ++i)
+				std::copy(row_unchecked(i), row_unchecked(i) + cols, result.data()[i]);
+			return result;
+		}
+
+		void swap(ring_matrix& other) noexcept
+		{
+			std::swap(table, other.table);
+			std::swap(head, other.head);
+			std::swap(count, other.count);
+			std::swap(cols, other.cols);
+			std::swap(alloc, other.alloc);
+		}
+
+	private:
+		template<class, class> friend class basic_row_iterator;
+
+		using elem_traits = std::allocator_traits<allocator_type>;
+
+		Index physical(Index x) const
+		{
+			const Index p = head + x;
+			return p >= capacity_rows() ? p - capacity_rows() : p;
+		}
+		T* row_unchecked(Index x) { return table[physical(x)]; }
+		const T* row_unchecked(Index x) const { return table[physical(x)]; }
+
+		void destroy_elems(T* p, Index n)
+		{
+			for (Index j = 0; j < n; ++j)
+				elem_traits::destroy(alloc, p + j);
+		}
+
+		// Destroys all rows and frees every row buffer.
+		void release() noexcept
+		{
+			clear();
+			for (T* p : table)
+				if (p != nullptr)
+					elem_traits::deallocate(alloc, p, cols);
+			table.clear();
+		}
+
+		void range_check(Index x, Index n) const
+		{
+			if (x < 0 || x >= n)
+				throw std::out_of_range{ "index is out of range of ring_matrix" };
+		}
+
+		std::vector<T*> table;
+		Index head{};
+		Index count{};
+		Index cols{};
+		allocator_type alloc;
+	};
+}
+
+#endif // RING_MATRIX_HPP
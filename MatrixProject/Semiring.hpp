@@ -0,0 +1,303 @@
+#pragma once
+#ifndef SEMIRING_HPP
+#define SEMIRING_HPP
+
+#include<limits>
+#include<vector>
+#include<cstdint>
+#include<stdexcept>
+#include<algorithm>
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Gemm.hpp"
+
+namespace my
+{
+	// Semiring policies for semiring_multiply and semiring_closure, in addition to
+	// plus_times (Gemm.hpp). zero() is the identity of add and absorbs mul, one() is the
+	// identity of mul.
+
+	// Shortest paths: add = min, mul = +, zero() = infinity (or max() for integers).
+	// For integers, mul saturates at zero() but the sum of two finite weights must fit T.
+	template<class T>
+	struct min_plus
+	{
+		static constexpr bool skip_zero = true;
+
+		static constexpr T zero() { return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(); }
+		static constexpr T one() { return T{}; }
+		static T add(T a, T b) { return b < a ? b : a; }
+		static T mul(T a, T b)
+		{
+			if constexpr (std::numeric_limits<T>::has_infinity)
+				return a + b;
+			else
+				return (a == zero() || b == zero()) ? zero() : a + b;
+		}
+	};
+
+	// Longest (critical) paths: add = max, mul = +, zero() = -infinity (or lowest()).
+	template<class T>
+	struct max_plus
+	{
+		static constexpr bool skip_zero = true;
+
+		static constexpr T zero() { return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(); }
+		static constexpr T one() { return T{}; }
+		static T add(T a, T b) { return a < b ? b : a; }
+		static T mul(T a, T b)
+		{
+			if constexpr (std::numeric_limits<T>::has_infinity)
+				return a + b;
+			else
+				return (a == zero() || b == zero()) ? zero() : a + b;
+		}
+	};
+
+	// Reachability: add = or, mul = and, on any T where nonzero means true. Results are
+	// T{ 1 } or T{}.
+	template<class T>
+	struct or_and
+	{
+		static constexpr bool skip_zero = true;
+
+		static constexpr T zero() { return T{}; }
+		static constexpr T one() { return T{ 1 }; }
+		static T add(T a, T b) { return (a != T{} || b != T{}) ? T{ 1 } : T{}; }
+		static T mul(T a, T b) { return (a != T{} && b != T{}) ? T{ 1 } : T{}; }
+	};
+
+	// Product of two matrices in the semiring S, with the cache tiling and threading of
+	// the builtin gemm kernels (Gemm.hpp).
+	template<class S, class T, class A>
+	matrix<T, A> semiring_multiply(const matrix<T, A>& a, const matrix<T, A>& b)
+	{
+		if (a.count_cols() != b.count_rows())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+
+		matrix<T, A> result(a.count_rows(), b.count_cols(), S::zero());
+		if (a.count_cols() == 0) return result;
+
+		const T* const* rows_a = a.data();
+		const table_rows<const T> rows_b{ b.data(), 0 };
+		T* const* rows_c = result.data();
+
+		parallel_for(0, a.count_rows(), gemm_block_m, [&](Index first, Index last) {
+			semiring_accumulate<S>(last - first, b.count_cols(), a.count_cols(),
+				table_rows<const T>{ rows_a + first, 0 }, rows_b, table_rows<T>{ rows_c + first, 0 });
+		});
+
+		return result;
+	}
+
+	namespace detail
+	{
+		constexpr Index closure_block = 64;
+		// minimal number of element updates handed to one thread
+		constexpr Index closure_grain = Index(1) << 18;
+
+		// d(i, j) = add(d(i, j), mul(d(i, k), d(k, j))) for k in [k0, k1) in this order,
+		// i in [i0, i1) and j in [j0, j1).
+		template<class S, class T>
+		void closure_block_update(T* const* d, Index i0, Index i1, Index j0, Index j1, Index k0, Index k1)
+		{
+			for (Index k = k0; k < k1; ++k)
+			{
+				const T* dk = d[k];
+				for (Index i = i0; i < i1; ++i)
+				{
+					T* di = d[i];
+					const T dik = di[k];
+					if constexpr (S::skip_zero)
+						if (dik == S::zero()) continue;
+
+					for (Index j = j0; j < j1; ++j)
+						di[j] = S::add(di[j], S::mul(dik, dk[j]));
+				}
+			}
+		}
+
+		// Rows of 0/1 values packed 64 per word.
+		struct bit_rows
+		{
+			Index rows{};
+			Index words{};
+			std::vector<std::uint64_t> bits;
+
+			bit_rows(Index rows, Index cols)
+				: rows{ rows }, words{ (cols + 63) / 64 }, bits(static_cast<std::size_t>(rows) * words) {}
+
+			std::uint64_t* row(Index i) { return bits.data() + static_cast<std::ptrdiff_t>(i) * words; }
+			const std::uint64_t* row(Index i) const { return bits.data() + static_cast<std::ptrdiff_t>(i) * words; }
+
+			static bool test(const std::uint64_t* r, Index j) { return (r[j >> 6] >> (j & 63)) & 1; }
+		};
+
+		template<class T, class A>
+		bit_rows pack_bits(const matrix<T, A>& m)
+		{
+			bit_rows result(m.count_rows(), m.count_cols());
+			for (Index i = 0; i < m.count_rows(); ++i)
+			{
+				const T* src = m.data()[i];
+				std::uint64_t* dst = result.row(i);
+				for (Index j = 0; j < m.count_cols(); ++j)
+					if (src[j] != T{})
+						dst[j >> 6] |= std::uint64_t(1) << (j & 63);
+			}
+			return result;
+		}
+
+		template<class T>
+		void unpack_bits(const std::uint64_t* src, T* dst, Index cols)
+		{
+			for (Index j = 0; j < cols; ++j)
+				dst[j] = bit_rows::test(src, j) ? T{ 1 } : T{};
+		}
+
+		inline void or_row(const std::uint64_t* src, std::uint64_t* dst, Index words)
+		{
+			for (Index w = 0; w < words; ++w)
+				dst[w] |= src[w];
+		}
+	}
+
+	// Closure of a square matrix in the semiring S, in place: d(i, j) becomes the sum
+	// (add) over all paths from i to j of the product (mul) of their weights, for
+	// semirings and inputs where this is finite. Diagonal entries are not reset: set
+	// d(i, i) = S::one() for the reflexive closure.
+	//
+	// Blocked Floyd-Warshall: for every diagonal block of closure_block rows, the block
+	// itself, then its row and column panels and then all remaining blocks are updated,
+	// the last step being a product in S with the tiling of semiring_multiply. Panels
+	// and remaining blocks are processed in parallel.
+	template<class S, class T, class A>
+	void semiring_closure(matrix<T, A>& d)
+	{
+		const Index n = d.count_rows();
+		if (d.count_cols() != n)
+			throw std::invalid_argument{ "closure requires a square matrix" };
+
+		const Index bs = detail::closure_block;
+		const Index blocks = (n + bs - 1) / bs;
+		T* const* rows = d.data();
+		const Index panel_grain = std::max<Index>(1, detail::closure_grain / (bs * bs * bs));
+		const Index rest_grain = std::max<Index>(1, detail::closure_grain / (bs * bs * std::max<Index>(n, 1)));
+
+		for (Index kb = 0; kb < blocks; ++kb)
+		{
+			const Index k0 = kb * bs;
+			const Index k1 = std::min(k0 + bs, n);
+
+			detail::closure_block_update<S>(rows, k0, k1, k0, k1, k0, k1);
+
+			parallel_for(0, blocks, panel_grain, [&](Index first, Index last) {
+				for (Index b = first; b < last; ++b)
+				{
+					if (b == kb) continue;
+					const Index b0 = b * bs;
+					const Index b1 = std::min(b0 + bs, n);
+					detail::closure_block_update<S>(rows, k0, k1, b0, b1, k0, k1);
+					detail::closure_block_update<S>(rows, b0, b1, k0, k1, k0, k1);
+				}
+			});
+
+			parallel_for(0, blocks, rest_grain, [&](Index first, Index last) {
+				for (Index b = first; b < last; ++b)
+				{
+					if (b == kb) continue;
+					const Index i0 = b * bs;
+					const Index i1 = std::min(i0 + bs, n);
+					auto panel = [&](Index i) { return rows[i0 + i] + k0; };
+					auto left = [&](Index i) { return rows[i0 + i]; };
+					auto right = [&](Index i) { return rows[i0 + i] + k1; };
+					auto top = [&](Index p) { return rows[k0 + p]; };
+					auto top_right = [&](Index p) { return rows[k0 + p] + k1; };
+					semiring_accumulate<S>(i1 - i0, k0, k1 - k0, panel, top, left);
+					semiring_accumulate<S>(i1 - i0, n - k1, k1 - k0, panel, top_right, right);
+				}
+			});
+		}
+	}
+
+	// All-pairs shortest paths, in place: d(i, j) is the weight of edge i -> j,
+	// min_plus<T>::zero() where there is none, and d(i, i) should be 0. Negative edges are
+	// allowed, negative cycles are not.
+	template<class T, class A>
+	void floyd_warshall(matrix<T, A>& d)
+	{
+		semiring_closure<min_plus<T>>(d);
+	}
+
+	// Boolean product (nonzero means true) with B packed to 64 columns per word: each
+	// true a(i, p) ORs row p of B into row i of the result. Results are T{ 1 } or T{}.
+	template<class T, class A>
+	matrix<T, A> boolean_multiply(const matrix<T, A>& a, const matrix<T, A>& b)
+	{
+		if (a.count_cols() != b.count_rows())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+
+		const detail::bit_rows packed_b = detail::pack_bits(b);
+		const Index words = packed_b.words;
+		matrix<T, A> result(a.count_rows(), b.count_cols(), T{});
+
+		const Index grain = std::max<Index>(1, detail::closure_grain / std::max<Index>(a.count_cols() * words, 1));
+		parallel_for(0, a.count_rows(), grain, [&](Index first, Index last) {
+			std::vector<std::uint64_t> acc(words);
+			for (Index i = first; i < last; ++i)
+			{
+				std::fill(acc.begin(), acc.end(), 0);
+				const T* a_row = a.data()[i];
+				for (Index p = 0; p < a.count_cols(); ++p)
+					if (a_row[p] != T{})
+						detail::or_row(packed_b.row(p), acc.data(), words);
+				detail::unpack_bits(acc.data(), result.data()[i], b.count_cols());
+			}
+		});
+		return result;
+	}
+
+	// Transitive closure of a square adjacency matrix (nonzero means an edge), in place:
+	// a(i, j) becomes T{ 1 } if j is reachable from i by a path of at least one edge and
+	// T{} otherwise. Warshall's algorithm on rows packed to 64 columns per word, one
+	// word column of pivots at a time: the pivot rows are closed first, then all other
+	// rows in parallel.
+	template<class T, class A>
+	void transitive_closure(matrix<T, A>& a)
+	{
+		const Index n = a.count_rows();
+		if (a.count_cols() != n)
+			throw std::invalid_argument{ "closure requires a square matrix" };
+
+		detail::bit_rows bits = detail::pack_bits(a);
+		const Index words = bits.words;
+		const Index grain = std::max<Index>(1, detail::closure_grain / std::max<Index>(64 * words, 1));
+
+		for (Index k0 = 0; k0 < n; k0 += 64)
+		{
+			const Index k1 = std::min<Index>(k0 + 64, n);
+			auto close_row = [&](Index i) {
+				std::uint64_t* ri = bits.row(i);
+				for (Index k = k0; k < k1; ++k)
+					if (detail::bit_rows::test(ri, k))
+						detail::or_row(bits.row(k), ri, words);
+			};
+
+			for (Index k = k0; k < k1; ++k)
+				for (Index i = k0; i < k1; ++i)
+					if (i != k && detail::bit_rows::test(bits.row(i), k))
+						detail::or_row(bits.row(k), bits.row(i), words);
+
+			parallel_for(0, n - (k1 - k0), grain, [&](Index first, Index last) {
+				for (Index t = first; t < last; ++t)
+					close_row(t < k0 ? t : t + (k1 - k0));
+			});
+		}
+
+		for (Index i = 0; i < n; ++i)
+			detail::unpack_bits(bits.row(i), a.data()[i], n);
+	}
+}
+
+#endif // SEMIRING_HPP
@@ -0,0 +1,376 @@
+#pragma once
+#ifndef SHARED_MATRIX_HPP
+#define SHARED_MATRIX_HPP
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include<atomic>
+#include<string>
+#include<cerrno>
+#include<cstdint>
+#include<cstring>
+#include<stdexcept>
+#include<algorithm>
+#include<type_traits>
+
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+#include"Matrix.hpp"
+
+namespace my
+{
+	// Sharing of read-only matrices between processes through POSIX shared memory
+	// (shm_open + mmap; link with -lrt on glibc older than 2.34).
+	//
+	// publish_shared(name, mtx) copies a matrix into a new shared memory object, one per
+	// published version, and makes it the current version of 'name'. A process attaches
+	// with shared_matrix_view<T>(name) in O(1): the object is mapped read-only and rows are
+	// found by offset, so no pointer is stored in shared memory and each process may map
+	// it at a different address. Publishing again swaps the current version atomically;
+	// views attached to the old version keep reading it until they refresh(), and its
+	// memory is released when the last of them is destroyed.
+	//
+	// Names follow shm_open rules: a leading '/' and no other '/'.
+
+	namespace detail
+	{
+		constexpr char shared_control_magic[8] = { 'M', 'Y', 'S', 'H', 'C', 'T', 'L', '1' };
+		constexpr char shared_matrix_magic[8] = { 'M', 'Y', 'S', 'H', 'M', 'T', 'X', '1' };
+		constexpr std::uint32_t shared_layout_version = 1;
+
+		// Object 'name': the version currently published.
+		struct shared_control
+		{
+			char magic[8];
+			std::atomic<std::uint64_t> current;
+			std::atomic<std::uint64_t> last;
+		};
+		static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared memory requires lock-free 64-bit atomics");
+
+		// Object 'name.version': this header, then rows of 'ld' elements at 'data_offset'.
+		struct shared_header
+		{
+			char magic[8];
+			std::uint32_t layout_version;
+			std::uint32_t elem_size;
+			std::uint64_t version;
+			std::int64_t rows;
+			std::int64_t cols;
+			std::int64_t ld;
+			std::uint64_t data_offset;
+		};
+
+		inline std::string shared_version_name(const std::string& name, std::uint64_t version)
+		{
+			return name + "." + std::to_string(version);
+		}
+
+		inline void shared_name_check(const std::string& name)
+		{
+			if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos)
+				throw std::invalid_argument{ "shared memory name must be '/' followed by a name without '/'" };
+		}
+
+		[[noreturn]] inline void shared_error(const std::string& what, const std::string& name)
+		{
+			throw std::runtime_error{ what + " " + name + ": " + std::strerror(errno) };
+		}
+
+		// Mapped shared memory object, unmapped on destruction.
+		class shared_mapping
+		{
+		public:
+			shared_mapping() {}
+			shared_mapping(void* p, std::size_t n) : ptr{ p }, len{ n } {}
+			shared_mapping(shared_mapping&& other) noexcept : ptr{ other.ptr }, len{ other.len } { other.ptr = nullptr; }
+			shared_mapping& operator=(shared_mapping&& other) noexcept
+			{
+				std::swap(ptr, other.ptr);
+				std::swap(len, other.len);
+				return *this;
+			}
+			~shared_mapping() { if (ptr != nullptr) ::munmap(ptr, len); }
+
+			void* get() const { return ptr; }
+			std::size_t size() const { return len; }
+
+		private:
+			void* ptr{};
+			std::size_t len{};
+		};
+
+		// Opens and maps the whole object; -1 from shm_open is reported through 'missing'.
+		inline shared_mapping map_shared(const std::string& name, int oflag, int prot, bool* missing = nullptr)
+		{
+			const int fd = ::shm_open(name.c_str(), oflag, 0600);
+			if (fd < 0)
+			{
+				if (missing != nullptr && errno == ENOENT)
+				{
+					*missing = true;
+					return {};
+				}
+				shared_error("unable to open shared memory object", name);
+			}
+
+			struct stat st;
+			if (::fstat(fd, &st) != 0)
+			{
+				::close(fd);
+				shared_error("unable to stat shared memory object", name);
+			}
+
+			const std::size_t n = static_cast<std::size_t>(st.st_size);
+			void* p = n == 0 ? MAP_FAILED : ::mmap(nullptr, n, prot, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (p == MAP_FAILED)
+			{
+				if (n == 0)
+					throw std::runtime_error{ "shared memory object " + name + " is empty" };
+				shared_error("unable to map shared memory object", name);
+			}
+			return { p, n };
+		}
+
+		// Maps the control object of 'name', creating it if needed.
+		inline shared_mapping open_control(const std::string& name)
+		{
+			const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+			if (fd < 0)
+				shared_error("unable to create shared memory object", name);
+
+			struct stat st;
+			if (::fstat(fd, &st) != 0 || (st.st_size < static_cast<off_t>(sizeof(shared_control)) && ::ftruncate(fd, sizeof(shared_control)) != 0))
+			{
+				::close(fd);
+				shared_error("unable to size shared memory object", name);
+			}
+
+			void* p = ::mmap(nullptr, sizeof(shared_control), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (p == MAP_FAILED)
+				shared_error("unable to map shared memory object", name);
+
+			// a fresh object is zero filled, i.e. the counters are 0 ("nothing published")
+			auto* ctl = static_cast<shared_control*>(p);
+			if (std::memcmp(ctl->magic, shared_control_magic, sizeof(ctl->magic)) != 0)
+				std::memcpy(ctl->magic, shared_control_magic, sizeof(ctl->magic));
+			return { p, sizeof(shared_control) };
+		}
+	}
+
+	// Read-only view of a published matrix.
+	template<class T>
+	class shared_matrix_view
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "shared matrices require a trivially copyable element type");
+
+	public:
+		// Attaches to the current version of 'name'.
+		explicit shared_matrix_view(const std::string& name) : name{ name }
+		{
+			detail::shared_name_check(name);
+			attach();
+		}
+
+		Index count_rows() const { return rows; }
+		Index count_cols() const { return cols; }
+		std::uint64_t version() const { return ver; }
+
+		const T* row(Index x) const
+		{
+			range_check(x, rows);
+			return row_unchecked(x);
+		}
+		const T* operator[](Index x) const { return row(x); }
+		const T& at(Index x, Index y) const
+		{
+			range_check(y, cols);
+			return row(x)[y];
+		}
+
+		// Whether a newer version has been published since this view was attached.
+		bool is_current() const
+		{
+			const auto* ctl = control_of();
+			return ctl == nullptr || ctl->current.load(std::memory_order_acquire) == ver;
+		}
+
+		// Re-attaches if a newer version exists; returns whether it did.
+		bool refresh()
+		{
+			if (is_current()) return false;
+			attach();
+			return true;
+		}
+
+		template<class MA = std::allocator<T>>
+		matrix<T, MA> to_matrix() const
+		{
+			matrix<T, MA> result(rows, cols);
+			for (Index i = 0; i < rows; ++i)
+				std::copy(row_unchecked(i), row_unchecked(i) + cols, result.data()[i]);
+			return result;
+		}
+
+	private:
+		const detail::shared_control* control_of() const { return static_cast<const detail::shared_control*>(control.get()); }
+
+		const T* row_unchecked(Index x) const
+		{
+			return reinterpret_cast<const T*>(static_cast<const char*>(data.get()) + data_offset) + static_cast<std::ptrdiff_t>(x) * ld;
+		}
+
+		void attach()
+		{
+			if (control.get() == nullptr)
+			{
+				bool missing = false;
+				control = detail::map_shared(name, O_RDONLY, PROT_READ, &missing);
+				if (missing || control.size() < sizeof(detail::shared_control) ||
+					std::memcmp(control_of()->magic, detail::shared_control_magic, sizeof(detail::shared_control_magic)) != 0)
+					throw std::runtime_error{ "no matrix is published as " + name };
+			}
+
+			// the version read may be replaced and unlinked before it is opened: retry
+			for (;;)
+			{
+				const std::uint64_t v = control_of()->current.load(std::memory_order_acquire);
+				if (v == 0)
+					throw std::runtime_error{ "no matrix is published as " + name };
+
+				bool missing = false;
+				auto mapped = detail::map_shared(detail::shared_version_name(name, v), O_RDONLY, PROT_READ, &missing);
+				if (missing) continue;
+
+				const auto* h = static_cast<const detail::shared_header*>(mapped.get());
+				if (mapped.size() < sizeof(detail::shared_header) ||
+					std::memcmp(h->magic, detail::shared_matrix_magic, sizeof(h->magic)) != 0 ||
+					h->layout_version != detail::shared_layout_version)
+					throw std::runtime_error{ "shared memory object of " + name + " has an unknown layout" };
+				if (h->elem_size != sizeof(T))
+					throw std::runtime_error{ "element size of shared matrix " + name + " does not match" };
+				if (h->data_offset + static_cast<std::uint64_t>(h->rows) * h->ld * sizeof(T) > mapped.size())
+					throw std::runtime_error{ "shared memory object of " + name + " is truncated" };
+
+				rows = static_cast<Index>(h->rows);
+				cols = static_cast<Index>(h->cols);
+				ld = static_cast<Index>(h->ld);
+				data_offset = static_cast<std::size_t>(h->data_offset);
+				ver = h->version;
+				data = std::move(mapped);
+				return;
+			}
+		}
+
+		void range_check(Index x, Index n) const
+		{
+			if (x < 0 || x >= n)
+				throw std::out_of_range{ "index is out of range of shared_matrix_view" };
+		}
+
+		std::string name;
+		detail::shared_mapping control;
+		detail::shared_mapping data;
+		Index rows{};
+		Index cols{};
+		Index ld{};
+		std::size_t data_offset{};
+		std::uint64_t ver{};
+	};
+
+	// Copies 'mtx' into shared memory as the new current version of 'name' and returns
+	// that version. The replaced version is unlinked: processes still viewing it keep
+	// their mapping, new views see the new version. If a concurrent publish with a higher
+	// version completed first, that one stays current and this copy is unlinked at once.
+	template<class T, class A>
+	std::uint64_t publish_shared(const std::string& name, const matrix<T, A>& mtx)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "shared matrices require a trivially copyable element type");
+		detail::shared_name_check(name);
+
+		auto control = detail::open_control(name);
+		auto* ctl = static_cast<detail::shared_control*>(control.get());
+		const std::uint64_t v = ctl->last.fetch_add(1, std::memory_order_acq_rel) + 1;
+		const std::string object = detail::shared_version_name(name, v);
+
+		// rows padded to whole cache lines
+		const std::size_t line = 64;
+		const std::int64_t ld = static_cast<std::int64_t>((mtx.count_cols() * sizeof(T) + line - 1) / line * line / sizeof(T));
+		const std::size_t offset = (sizeof(detail::shared_header) + line - 1) / line * line;
+		const std::size_t bytes = offset + static_cast<std::size_t>(mtx.count_rows()) * static_cast<std::size_t>(ld) * sizeof(T);
+
+		const int fd = ::shm_open(object.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0)
+			detail::shared_error("unable to create shared memory object", object);
+		if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+		{
+			::close(fd);
+			::shm_unlink(object.c_str());
+			detail::shared_error("unable to size shared memory object", object);
+		}
+		void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+		{
+			::shm_unlink(object.c_str());
+			detail::shared_error("unable to map shared memory object", object);
+		}
+		detail::shared_mapping mapped(p, bytes);
+
+		auto* h = static_cast<detail::shared_header*>(p);
+		std::memcpy(h->magic, detail::shared_matrix_magic, sizeof(h->magic));
+		h->layout_version = detail::shared_layout_version;
+		h->elem_size = sizeof(T);
+		h->version = v;
+		h->rows = mtx.count_rows();
+		h->cols = mtx.count_cols();
+		h->ld = ld;
+		h->data_offset = offset;
+
+		T* base = reinterpret_cast<T*>(static_cast<char*>(p) + offset);
+		for (Index i = 0; i < mtx.count_rows(); ++i)
+			std::copy(mtx.data()[i], mtx.data()[i] + mtx.count_cols(), base + static_cast<std::ptrdiff_t>(i) * ld);
+
+		// Publishers may finish out of order: install v only over an older version, so a
+		// slow publisher never replaces (and unlinks) a newer one.
+		std::uint64_t replaced = ctl->current.load(std::memory_order_acquire);
+		while (replaced < v)
+		{
+			if (ctl->current.compare_exchange_weak(replaced, v, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				if (replaced != 0)
+					::shm_unlink(detail::shared_version_name(name, replaced).c_str());
+				return v;
+			}
+		}
+		::shm_unlink(object.c_str());
+		return v;
+	}
+
+	// Removes 'name' and its current version. Existing views stay valid.
+	inline void unlink_shared(const std::string& name)
+	{
+		detail::shared_name_check(name);
+
+		bool missing = false;
+		auto control = detail::map_shared(name, O_RDWR, PROT_READ | PROT_WRITE, &missing);
+		if (missing) return;
+
+		if (control.size() >= sizeof(detail::shared_control))
+		{
+			auto* ctl = static_cast<detail::shared_control*>(control.get());
+			const std::uint64_t v = ctl->current.exchange(0, std::memory_order_acq_rel);
+			if (v != 0)
+				::shm_unlink(detail::shared_version_name(name, v).c_str());
+		}
+		::shm_unlink(name.c_str());
+	}
+}
+
+#endif // defined(__unix__) || defined(__APPLE__)
+
+#endif // SHARED_MATRIX_HPP
@@ -0,0 +1,285 @@
+#pragma once
+#ifndef STENCIL_HPP
+#define STENCIL_HPP
+
+#include<vector>
+#include<stdexcept>
+#include<algorithm>
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Gemv.hpp"
+
+namespace my
+{
+	// Values read outside the grid:
+	//   zero:  0;
+	//   clamp: the nearest edge value;
+	//   wrap:  the grid repeats periodically.
+	enum class border { zero, clamp, wrap };
+
+	// The grid is processed in tiles of tile_rows x tile_cols, each loaded into a private
+	// buffer together with the halo the kernel reads around it, so that every source value
+	// is fetched from memory once per tile while all kernel taps run in cache. Tiles are
+	// processed in parallel.
+	//
+	// Iterated stencils advance each tile by time_block steps before writing it back
+	// (temporal blocking): the halo is time_block times wider and shrinks by one kernel
+	// radius per step. This trades some redundant work at the tile edges for
+	// time_block times less memory traffic.
+	struct stencil_options
+	{
+		Index tile_rows{ 64 };
+		Index tile_cols{ 256 };
+		Index time_block{ 4 };
+	};
+
+	namespace detail
+	{
+		// Grid index read for global index g of a grid of n, or -1 for a zero value.
+		inline Index border_index(Index g, Index n, border b)
+		{
+			if (g >= 0 && g < n) return g;
+			switch (b)
+			{
+			case border::clamp: return g < 0 ? 0 : n - 1;
+			case border::wrap: { const Index m = g % n; return m < 0 ? m + n : m; }
+			default: return -1;
+			}
+		}
+
+		// Rectangular buffer covering global rows [row0, row0 + rows) and columns
+		// [col0, col0 + cols) of a grid, possibly extending past its edges.
+		template<class T>
+		struct stencil_tile
+		{
+			Index row0{};
+			Index col0{};
+			Index rows{};
+			Index cols{};
+			std::vector<T> buf;
+
+			T* row(Index i) { return buf.data() + static_cast<std::ptrdiff_t>(i) * cols; }
+			const T* row(Index i) const { return buf.data() + static_cast<std::ptrdiff_t>(i) * cols; }
+		};
+
+		template<class T, class A>
+		void load_tile(const matrix<T, A>& src, border b, stencil_tile<T>& t)
+		{
+			const Index n = src.count_rows();
+			const Index m = src.count_cols();
+			const Index in_first = std::clamp<Index>(-t.col0, 0, t.cols);
+			const Index in_last = std::clamp<Index>(m - t.col0, in_first, t.cols);
+
+			t.buf.resize(static_cast<std::size_t>(t.rows) * t.cols);
+			for (Index i = 0; i < t.rows; ++i)
+			{
+				T* dst = t.row(i);
+				const Index si = border_index(t.row0 + i, n, b);
+				if (si < 0)
+				{
+					std::fill(dst, dst + t.cols, T{});
+					continue;
+				}
+
+				const T* s = src.data()[si];
+				std::copy(s + t.col0 + in_first, s + t.col0 + in_last, dst + in_first);
+				for (Index j = 0; j < in_first; ++j)
+				{
+					const Index sj = border_index(t.col0 + j, m, b);
+					dst[j] = sj < 0 ? T{} : s[sj];
+				}
+				for (Index j = in_last; j < t.cols; ++j)
+				{
+					const Index sj = border_index(t.col0 + j, m, b);
+					dst[j] = sj < 0 ? T{} : s[sj];
+				}
+			}
+		}
+
+		// out(i, j) = sum of k(di, dj) * in(i + di - kr / 2, j + dj - kc / 2) for rows
+		// [i0, i1) and columns [j0, j1) of two buffers of the same shape. The innermost loop
+		// runs along a row, one tap at a time, so that it is vectorized.
+		template<class T>
+		void apply_taps(const stencil_tile<T>& in, stencil_tile<T>& out, Index i0, Index i1, Index j0, Index j1,
+			const T* k, Index kr, Index kc)
+		{
+			const Index rr = kr / 2;
+			const Index rc = kc / 2;
+			for (Index i = i0; i < i1; ++i)
+			{
+				T* o = out.row(i);
+				std::fill(o + j0, o + j1, T{});
+				for (Index di = 0; di < kr; ++di)
+				{
+					const T* s = in.row(i + di - rr) - rc;
+					for (Index dj = 0; dj < kc; ++dj)
+					{
+						const T w = k[di * kc + dj];
+						if (w == T{}) continue;
+						for (Index j = j0; j < j1; ++j)
+							o[j] += w * s[j + dj];
+					}
+				}
+			}
+		}
+
+		// Re-reads the clamp halo of a buffer from the edge values computed in it.
+		template<class T>
+		void refresh_clamp_halo(stencil_tile<T>& t, Index n, Index m)
+		{
+			for (Index i = 0; i < t.rows; ++i)
+			{
+				const Index ci = std::clamp<Index>(t.row0 + i, 0, n - 1) - t.row0;
+				if (ci < 0 || ci >= t.rows) continue;
+				T* dst = t.row(i);
+				const T* s = t.row(ci);
+				for (Index j = 0; j < t.cols; ++j)
+				{
+					const Index cj = std::clamp<Index>(t.col0 + j, 0, m - 1) - t.col0;
+					if ((ci != i || cj != j) && cj >= 0 && cj < t.cols)
+						dst[j] = s[cj];
+				}
+			}
+		}
+
+		template<class T, class A>
+		void store_tile(const stencil_tile<T>& t, Index halo_r, Index halo_c, Index rows, Index cols, matrix<T, A>& dst)
+		{
+			for (Index i = 0; i < rows; ++i)
+			{
+				const T* s = t.row(halo_r + i) + halo_c;
+				std::copy(s, s + cols, dst.data()[t.row0 + halo_r + i] + t.col0 + halo_c);
+			}
+		}
+
+		template<class F>
+		void for_each_tile(Index n, Index m, const stencil_options& opt, F f)
+		{
+			const Index tr = std::max<Index>(1, opt.tile_rows);
+			const Index tc = std::max<Index>(1, opt.tile_cols);
+			const Index tiles_r = (n + tr - 1) / tr;
+			const Index tiles_c = (m + tc - 1) / tc;
+			parallel_for(0, tiles_r * tiles_c, 1, [&](Index first, Index last) {
+				for (Index t = first; t < last; ++t)
+				{
+					const Index r0 = t / tiles_c * tr;
+					const Index c0 = t % tiles_c * tc;
+					f(r0, c0, std::min(tr, n - r0), std::min(tc, m - c0));
+				}
+			});
+		}
+
+		template<class T, class KA>
+		void check_kernel(const matrix<T, KA>& kernel)
+		{
+			if (kernel.count_rows() % 2 == 0 || kernel.count_cols() % 2 == 0)
+				throw std::invalid_argument{ "stencil kernel must have odd sizes" };
+		}
+
+		// 'steps' applications of the kernel to src, written to dst.
+		template<class T, class A>
+		void stencil_round(const matrix<T, A>& src, matrix<T, A>& dst, const std::vector<T>& k, Index kr, Index kc,
+			Index steps, border b, const stencil_options& opt)
+		{
+			const Index n = src.count_rows();
+			const Index m = src.count_cols();
+			const Index rr = kr / 2;
+			const Index rc = kc / 2;
+
+			for_each_tile(n, m, opt, [&](Index r0, Index c0, Index rows, Index cols) {
+				const Index hr = steps * rr;
+				const Index hc = steps * rc;
+				stencil_tile<T> cur{ r0 - hr, c0 - hc, rows + 2 * hr, cols + 2 * hc, {} };
+				load_tile(src, b, cur);
+				stencil_tile<T> next = cur;
+
+				// outside the grid only the wrap policy has values to compute
+				const bool bounded = b != border::wrap;
+				const Index grid_i0 = bounded ? std::max<Index>(0, -cur.row0) : 0;
+				const Index grid_i1 = bounded ? std::min<Index>(cur.rows, n - cur.row0) : cur.rows;
+				const Index grid_j0 = bounded ? std::max<Index>(0, -cur.col0) : 0;
+				const Index grid_j1 = bounded ? std::min<Index>(cur.cols, m - cur.col0) : cur.cols;
+
+				for (Index s = 1; s <= steps; ++s)
+				{
+					const Index i0 = std::max(s * rr, grid_i0);
+					const Index i1 = std::min(cur.rows - s * rr, grid_i1);
+					const Index j0 = std::max(s * rc, grid_j0);
+					const Index j1 = std::min(cur.cols - s * rc, grid_j1);
+					apply_taps(cur, next, i0, i1, j0, j1, k.data(), kr, kc);
+					if (b == border::clamp)
+						refresh_clamp_halo(next, n, m);
+					std::swap(cur, next);
+				}
+				store_tile(cur, hr, hc, rows, cols, dst);
+			});
+		}
+	}
+
+	// Applies 'iterations' times the stencil out(i, j) = sum of kernel(di, dj) *
+	// in(i + di - r, j + dj - c), r and c being the kernel radii (the kernel is not
+	// flipped, i.e. this is a correlation). Kernel sizes must be odd.
+	template<class T, class A, class KA>
+	matrix<T, A> iterate_stencil(const matrix<T, A>& src, const matrix<T, KA>& kernel, Index iterations,
+		border b = border::zero, const stencil_options& opt = stencil_options())
+	{
+		detail::check_kernel(kernel);
+		if (iterations < 0)
+			throw std::invalid_argument{ "iterations count must be positive" };
+
+		std::vector<T> k;
+		k.reserve(static_cast<std::size_t>(kernel.count_rows()) * kernel.count_cols());
+		for (Index i = 0; i < kernel.count_rows(); ++i)
+			k.insert(k.end(), kernel.data()[i], kernel.data()[i] + kernel.count_cols());
+
+		matrix<T, A> cur = src;
+		if (src.count_rows() == 0 || src.count_cols() == 0) return cur;
+
+		matrix<T, A> next(src.count_rows(), src.count_cols());
+		const Index block = std::max<Index>(1, opt.time_block);
+		for (Index done = 0; done < iterations; done += block)
+		{
+			detail::stencil_round(cur, next, k, kernel.count_rows(), kernel.count_cols(), std::min(block, iterations - done), b, opt);
+			cur.swap(next);
+		}
+		return cur;
+	}
+
+	// Single application of a 2D filter kernel, see iterate_stencil.
+	template<class T, class A, class KA>
+	matrix<T, A> filter2d(const matrix<T, A>& src, const matrix<T, KA>& kernel,
+		border b = border::zero, const stencil_options& opt = stencil_options())
+	{
+		return iterate_stencil(src, kernel, 1, b, opt);
+	}
+
+	// Filter with the separable kernel col_kernel * transpose(row_kernel): a horizontal
+	// pass with row_kernel and a vertical pass with col_kernel on each tile, which costs
+	// kr + kc instead of kr * kc operations per element.
+	template<class T, class A>
+	matrix<T, A> filter_separable(const matrix<T, A>& src, detail::non_deduced_t<vector_view<const T>> row_kernel,
+		detail::non_deduced_t<vector_view<const T>> col_kernel, border b = border::zero, const stencil_options& opt = stencil_options())
+	{
+		const Index kc = row_kernel.size();
+		const Index kr = col_kernel.size();
+		if (kr % 2 == 0 || kc % 2 == 0)
+			throw std::invalid_argument{ "stencil kernel must have odd sizes" };
+
+		matrix<T, A> result(src.count_rows(), src.count_cols());
+		detail::for_each_tile(src.count_rows(), src.count_cols(), opt, [&](Index r0, Index c0, Index rows, Index cols) {
+			const Index hr = kr / 2;
+			const Index hc = kc / 2;
+			detail::stencil_tile<T> in{ r0 - hr, c0 - hc, rows + 2 * hr, cols + 2 * hc, {} };
+			detail::load_tile(src, b, in);
+			detail::stencil_tile<T> tmp = in;
+
+			detail::apply_taps(in, tmp, 0, in.rows, hc, in.cols - hc, row_kernel.data(), 1, kc);
+			detail::apply_taps(tmp, in, hr, in.rows - hr, hc, in.cols - hc, col_kernel.data(), kr, 1);
+			detail::store_tile(in, hr, hc, rows, cols, result);
+		});
+		return result;
+	}
+}
+
+#endif // STENCIL_HPP
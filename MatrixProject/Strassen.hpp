@@ -0,0 +1,342 @@
+#pragma once
+#ifndef STRASSEN_HPP
+#define STRASSEN_HPP
+
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+#include<stdexcept>
+#include<type_traits>
+#include<algorithm>
+
+#include"Matrix.hpp"
+#include"Parallel.hpp"
+#include"Gemm.hpp"
+#include"Backend.hpp"
+
+namespace my
+{
+	// Parameters of strassen_multiply.
+	//
+	// cutoff: blocks of this order or smaller are multiplied conventionally, on the active
+	// backend (Backend.hpp) when it takes them and with gemm_accumulate otherwise. Every
+	// recursion level saves 1/8 of the multiplications but costs 15 additions of
+	// quarter-size blocks and loses accuracy, so the cutoff should be well above the point
+	// where the additions start to dominate (typically 64..512).
+	//
+	// Accuracy: the Strassen-Winograd error bound is normwise only,
+	//     |C - fl(C)| <= c * (n / cutoff)^log2(18) * cutoff^2 * u * |A| * |B|,
+	// versus n * u * |A| * |B| (componentwise) for the conventional product, so every level
+	// multiplies the bound by about 18/4. Elements of C that are small relative to |A||B|
+	// may lose most of their significant digits; prefer double and larger cutoffs when this
+	// matters, and do not use it for badly scaled data.
+	//
+	// parallel: run the seven top-level sub-products on separate threads. This needs
+	// additional workspace, see strassen_workspace_size.
+	struct strassen_options
+	{
+		Index cutoff{ 128 };
+		bool parallel{ true };
+	};
+
+	namespace detail
+	{
+		template<class T>
+		struct strassen_block
+		{
+			T* base{};
+			std::ptrdiff_t ld{};
+
+			T* row(Index i) const { return base + static_cast<std::ptrdiff_t>(i) * ld; }
+			strassen_block quad(Index r, Index c, Index h) const { return { row(r * h) + c * h, ld }; }
+			strided_rows<T> rows() const { return { base, ld }; }
+		};
+
+		// Sizes of the recursion: 'order' is n rounded up to leaf * 2^levels with leaf <= cutoff.
+		struct strassen_plan
+		{
+			Index levels{};
+			Index order{};
+		};
+
+		inline strassen_plan make_strassen_plan(Index n, Index cutoff)
+		{
+			strassen_plan plan{ 0, n };
+			Index leaf = n;
+			while (leaf > cutoff)
+			{
+				leaf = (leaf + 1) / 2;
+				++plan.levels;
+			}
+			plan.order = leaf << plan.levels;
+			return plan;
+		}
+
+		inline std::size_t square(Index n) { return static_cast<std::size_t>(n) * static_cast<std::size_t>(n); }
+
+		// Workspace of the sequential recursion: three half-size temporaries per level.
+		inline std::size_t strassen_sequential_workspace(Index n, Index cutoff)
+		{
+			std::size_t total = 0;
+			for (; n > cutoff; n /= 2)
+				total += 3 * square(n / 2);
+			return total;
+		}
+
+		template<class T, class Op>
+		void strassen_apply(Index h, strassen_block<T> dst, Op op)
+		{
+			for (Index i = 0; i < h; ++i)
+			{
+				T* d = dst.row(i);
+				for (Index j = 0; j < h; ++j)
+					op(d[j], i, j);
+			}
+		}
+
+		template<class T>
+		void strassen_add(Index h, strassen_block<T> dst, strassen_block<T> x, strassen_block<T> y)
+		{
+			strassen_apply(h, dst, [&](T& d, Index i, Index j) { d = x.row(i)[j] + y.row(i)[j]; });
+		}
+		template<class T>
+		void strassen_sub(Index h, strassen_block<T> dst, strassen_block<T> x, strassen_block<T> y)
+		{
+			strassen_apply(h, dst, [&](T& d, Index i, Index j) { d = x.row(i)[j] - y.row(i)[j]; });
+		}
+		template<class T>
+		void strassen_acc(Index h, strassen_block<T> dst, strassen_block<T> x)
+		{
+			strassen_apply(h, dst, [&](T& d, Index i, Index j) { d += x.row(i)[j]; });
+		}
+		template<class T>
+		void strassen_dec(Index h, strassen_block<T> dst, strassen_block<T> x)
+		{
+			strassen_apply(h, dst, [&](T& d, Index i, Index j) { d -= x.row(i)[j]; });
+		}
+
+		template<class T>
+		void strassen_leaf(Index n, strassen_block<T> a, strassen_block<T> b, strassen_block<T> c)
+		{
+			if constexpr (is_blas_type_v<T>)
+			{
+				if (compute_backend* be = routed_backend<T>(std::int64_t(n) * n * n))
+				{
+					be->gemm(n, n, n, T{ 1 }, a.base, static_cast<Index>(a.ld), b.base, static_cast<Index>(b.ld), T{}, c.base, static_cast<Index>(c.ld));
+					return;
+				}
+			}
+			for (Index i = 0; i < n; ++i)
+				std::fill(c.row(i), c.row(i) + n, T{});
+			gemm_accumulate<T>(n, n, n, a.rows(), b.rows(), c.rows());
+		}
+
+		// C = A * B for n x n blocks with the Winograd variant (7 products, 15 additions),
+		// scheduled so that only three half-size temporaries X, Y, Z are needed besides the
+		// quadrants of C. 'ws' must hold strassen_sequential_workspace(n, cutoff) elements.
+		template<class T>
+		void strassen_sequential(Index n, strassen_block<T> a, strassen_block<T> b, strassen_block<T> c, T* ws, Index cutoff)
+		{
+			if (n <= cutoff)
+			{
+				strassen_leaf(n, a, b, c);
+				return;
+			}
+
+			const Index h = n / 2;
+			const auto a11 = a.quad(0, 0, h), a12 = a.quad(0, 1, h), a21 = a.quad(1, 0, h), a22 = a.quad(1, 1, h);
+			const auto b11 = b.quad(0, 0, h), b12 = b.quad(0, 1, h), b21 = b.quad(1, 0, h), b22 = b.quad(1, 1, h);
+			const auto c11 = c.quad(0, 0, h), c12 = c.quad(0, 1, h), c21 = c.quad(1, 0, h), c22 = c.quad(1, 1, h);
+
+			const strassen_block<T> x{ ws, h };
+			const strassen_block<T> y{ ws + square(h), h };
+			const strassen_block<T> z{ ws + 2 * square(h), h };
+			T* next = ws + 3 * square(h);
+
+			strassen_sub(h, x, a11, a21);                // S3
+			strassen_sub(h, y, b22, b12);                // T3
+			strassen_sequential(h, x, y, c21, next, cutoff); // P7
+			strassen_add(h, x, a21, a22);                // S1
+			strassen_sub(h, y, b12, b11);                // T1
+			strassen_sequential(h, x, y, c22, next, cutoff); // P5
+			strassen_sub(h, x, x, a11);                  // S2
+			strassen_sub(h, y, b22, y);                  // T2
+			strassen_sequential(h, x, y, c12, next, cutoff); // P6
+			strassen_sub(h, x, a12, x);                  // S4
+			strassen_sub(h, y, y, b21);                  // T4
+			strassen_sequential(h, a11, b11, c11, next, cutoff); // P1
+
+			strassen_acc(h, c12, c11);                   // U2 = P1 + P6
+			strassen_acc(h, c21, c12);                   // U3 = U2 + P7
+			strassen_acc(h, c12, c22);                   // U4 = U2 + P5
+			strassen_acc(h, c22, c21);                   // U7 = U3 + P5
+
+			strassen_sequential(h, x, b22, z, next, cutoff); // P3
+			strassen_acc(h, c12, z);                     // U5 = U4 + P3
+			strassen_sequential(h, a22, y, z, next, cutoff); // P4
+			strassen_dec(h, c21, z);                     // U6 = U3 - P4
+			strassen_sequential(h, a12, b21, z, next, cutoff); // P2
+			strassen_acc(h, c11, z);                     // U1 = P1 + P2
+		}
+
+		// Number of half-size buffers used by strassen_parallel besides the lower levels:
+		// operands of P3..P7 (8) and results of P2, P3, P4 (3).
+		constexpr std::size_t strassen_parallel_buffers = 11;
+
+		inline std::size_t strassen_parallel_workspace(Index n, Index cutoff)
+		{
+			if (n <= cutoff) return 0;
+			const Index h = n / 2;
+			return strassen_parallel_buffers * square(h) + 7 * strassen_sequential_workspace(h, cutoff);
+		}
+
+		// Top level with the seven products computed concurrently, each one with its own
+		// operands and its own workspace for the sequential recursion below.
+		template<class T>
+		void strassen_parallel(Index n, strassen_block<T> a, strassen_block<T> b, strassen_block<T> c, T* ws, Index cutoff)
+		{
+			const Index h = n / 2;
+			const auto a11 = a.quad(0, 0, h), a12 = a.quad(0, 1, h), a21 = a.quad(1, 0, h), a22 = a.quad(1, 1, h);
+			const auto b11 = b.quad(0, 0, h), b12 = b.quad(0, 1, h), b21 = b.quad(1, 0, h), b22 = b.quad(1, 1, h);
+			const auto c11 = c.quad(0, 0, h), c12 = c.quad(0, 1, h), c21 = c.quad(1, 0, h), c22 = c.quad(1, 1, h);
+
+			strassen_block<T> buf[strassen_parallel_buffers];
+			for (std::size_t i = 0; i < strassen_parallel_buffers; ++i)
+				buf[i] = { ws + i * square(h), h };
+
+			const std::size_t lower = strassen_sequential_workspace(h, cutoff);
+			T* const lower_ws = ws + strassen_parallel_buffers * square(h);
+
+			const auto q2 = buf[0], q3 = buf[1], q4 = buf[2];
+
+			parallel_for(0, 7, 1, [&](Index first, Index last) {
+				for (Index task = first; task < last; ++task)
+				{
+					T* next = lower_ws + task * lower;
+					switch (task)
+					{
+					case 0: // P1 = A11 * B11
+						strassen_sequential(h, a11, b11, c11, next, cutoff);
+						break;
+					case 1: // P2 = A12 * B21
+						strassen_sequential(h, a12, b21, q2, next, cutoff);
+						break;
+					case 2: // P3 = S4 * B22, S4 = A12 - (A21 + A22 - A11)
+						strassen_add(h, buf[3], a21, a22);
+						strassen_sub(h, buf[3], buf[3], a11);
+						strassen_sub(h, buf[3], a12, buf[3]);
+						strassen_sequential(h, buf[3], b22, q3, next, cutoff);
+						break;
+					case 3: // P4 = A22 * T4, T4 = B22 - (B12 - B11) - B21
+						strassen_sub(h, buf[4], b12, b11);
+						strassen_sub(h, buf[4], b22, buf[4]);
+						strassen_sub(h, buf[4], buf[4], b21);
+						strassen_sequential(h, a22, buf[4], q4, next, cutoff);
+						break;
+					case 4: // P5 = S1 * T1
+						strassen_add(h, buf[5], a21, a22);
+						strassen_sub(h, buf[6], b12, b11);
+						strassen_sequential(h, buf[5], buf[6], c22, next, cutoff);
+						break;
+					case 5: // P6 = S2 * T2
+						strassen_add(h, buf[7], a21, a22);
+						strassen_sub(h, buf[7], buf[7], a11);
+						strassen_sub(h, buf[8], b12, b11);
+						strassen_sub(h, buf[8], b22, buf[8]);
+						strassen_sequential(h, buf[7], buf[8], c12, next, cutoff);
+						break;
+					case 6: // P7 = S3 * T3
+						strassen_sub(h, buf[9], a11, a21);
+						strassen_sub(h, buf[10], b22, b12);
+						strassen_sequential(h, buf[9], buf[10], c21, next, cutoff);
+						break;
+					}
+				}
+			});
+
+			parallel_for(0, h, 16, [&](Index first, Index last) {
+				for (Index i = first; i < last; ++i)
+				{
+					T* r11 = c11.row(i);
+					T* r12 = c12.row(i);
+					T* r21 = c21.row(i);
+					T* r22 = c22.row(i);
+					const T* p2 = q2.row(i);
+					const T* p3 = q3.row(i);
+					const T* p4 = q4.row(i);
+					for (Index j = 0; j < h; ++j)
+					{
+						const T u2 = r11[j] + r12[j];
+						const T u3 = u2 + r21[j];
+						const T u4 = u2 + r22[j];
+						r11[j] += p2[j];
+						r12[j] = u4 + p3[j];
+						r21[j] = u3 - p4[j];
+						r22[j] = u3 + r22[j];
+					}
+				}
+			});
+		}
+	}
+
+	// Number of elements of T allocated by strassen_multiply for n x n operands, including
+	// the zero-padded copies of A, B and C.
+	inline std::size_t strassen_workspace_size(Index n, const strassen_options& options = strassen_options())
+	{
+		if (n <= options.cutoff) return 0;
+
+		const auto plan = detail::make_strassen_plan(n, options.cutoff);
+		const std::size_t recursion = options.parallel
+			? detail::strassen_parallel_workspace(plan.order, options.cutoff)
+			: detail::strassen_sequential_workspace(plan.order, options.cutoff);
+		return 3 * detail::square(plan.order) + recursion;
+	}
+
+	// Strassen-Winograd product of two square matrices. Operands are copied into a single
+	// workspace allocated up front, zero-padded to cutoff-compatible order; see
+	// strassen_options for the choice of cutoff and the accuracy of the result.
+	template<class T, class A>
+	matrix<T, A> strassen_multiply(const matrix<T, A>& a, const matrix<T, A>& b, const strassen_options& options = strassen_options())
+	{
+		static_assert(std::is_floating_point_v<T>, "strassen_multiply requires a floating point element type");
+
+		if (a.count_rows() != a.count_cols() || b.count_rows() != b.count_cols())
+			throw std::invalid_argument{ "strassen_multiply requires square matrices" };
+		if (a.count_rows() != b.count_rows())
+			throw std::invalid_argument{ "matrices for strassen_multiply should be equal by size" };
+		if (options.cutoff < 1)
+			throw std::invalid_argument{ "strassen cutoff must be positive" };
+
+		const Index n = a.count_rows();
+		if (n <= options.cutoff)
+			return multiply(a, b);
+
+		const auto plan = detail::make_strassen_plan(n, options.cutoff);
+		const Index order = plan.order;
+
+		std::vector<T> workspace(strassen_workspace_size(n, options));
+		const detail::strassen_block<T> pa{ workspace.data(), order };
+		const detail::strassen_block<T> pb{ workspace.data() + detail::square(order), order };
+		const detail::strassen_block<T> pc{ workspace.data() + 2 * detail::square(order), order };
+		T* ws = workspace.data() + 3 * detail::square(order);
+
+		for (Index i = 0; i < n; ++i)
+		{
+			std::copy(a.data()[i], a.data()[i] + n, pa.row(i));
+			std::copy(b.data()[i], b.data()[i] + n, pb.row(i));
+		}
+
+		if (options.parallel)
+			detail::strassen_parallel(order, pa, pb, pc, ws, options.cutoff);
+		else
+			detail::strassen_sequential(order, pa, pb, pc, ws, options.cutoff);
+
+		matrix<T, A> result(n, n);
+		for (Index i = 0; i < n; ++i)
+			std::copy(pc.row(i), pc.row(i) + n, result.data()[i]);
+
+		return result;
+	}
+}
+
+#endif // STRASSEN_HPP
@@ -0,0 +1,597 @@
+#pragma once
+#ifndef TILED_MATRIX_HPP
+#define TILED_MATRIX_HPP
+
+#include<list>
+#include<mutex>
+#include<deque>
+#include<string>
+#include<thread>
+#include<vector>
+#include<cstdint>
+#include<cstring>
+#include<fstream>
+#include<limits>
+#include<filesystem>
+#include<stdexcept>
+#include<algorithm>
+#include<type_traits>
+#include<unordered_map>
+#include<condition_variable>
+
+#include"Matrix.hpp"
+#include"Gemm.hpp"
+#include"Reductions.hpp"
+
+namespace my
+{
+	// Matrix stored in a file as fixed-size tiles, for data larger than memory. Only
+	// 'cache_tiles' tiles are held in memory, in an LRU cache; modified tiles are written
+	// back when evicted, on flush() and on destruction. Tiles at the right and bottom edges
+	// are stored whole and padded with zeros.
+	//
+	// File layout: a header (magic, sizes, sizeof(T)) followed by the tiles in row-major
+	// tile order, each tile row-major with tile_cols() elements per row.
+	//
+	// Element access (get/set) is convenient but looks up the cache every time; algorithms
+	// should pin() whole tiles. When tiles are pinned in row-major or column-major order the
+	// following tiles are read ahead on a background thread (see set_prefetch_depth), and
+	// prefetch() requests a tile explicitly.
+	//
+	// A tiled_matrix may be used by one thread at a time (besides its own prefetcher).
+	template<class T>
+	class tiled_matrix
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "tiled_matrix requires a trivially copyable element type");
+
+		struct entry;
+
+	public:
+		// Pinned tile: stays in the cache while the handle lives.
+		class tile
+		{
+			friend class tiled_matrix;
+		public:
+			tile(tile&& other) noexcept : owner{ other.owner }, e{ other.e } { other.owner = nullptr; }
+			tile(const tile&) = delete;
+			tile& operator=(const tile&) = delete;
+			tile& operator=(tile&&) = delete;
+			~tile() { if (owner) owner->unpin(e); }
+
+			// tile_rows() x tile_cols() elements, row-major.
+			T* data() { return e->buf.data(); }
+			const T* data() const { return e->buf.data(); }
+			Index leading_dimension() const { return owner->tile_c; }
+			T* row(Index r) { return data() + static_cast<std::ptrdiff_t>(r) * owner->tile_c; }
+			const T* row(Index r) const { return data() + static_cast<std::ptrdiff_t>(r) * owner->tile_c; }
+
+		private:
+			tile(tiled_matrix* owner, entry* e) : owner{ owner }, e{ e } {}
+
+			tiled_matrix* owner{};
+			entry* e{};
+		};
+
+		// Creates a new file (replacing an existing one) filled with zeros.
+		explicit tiled_matrix(const std::string& path, Index rows, Index cols, Index tile_rows, Index tile_cols, Index cache_tiles)
+			: rows{ rows }, cols{ cols }, tile_r{ tile_rows }, tile_c{ tile_cols }, capacity{ cache_tiles }
+		{
+			if (rows < 0 || cols < 0 || tile_rows <= 0 || tile_cols <= 0)
+				throw std::invalid_argument{ "tiled_matrix size arguments must be positive" };
+			check_capacity();
+			const std::int64_t bytes = file_bytes();
+
+			{
+				std::ofstream create(path, std::ios::binary | std::ios::trunc);
+				if (!create)
+					throw std::runtime_error{ "unable to create tiled matrix file: " + path };
+				const header h = make_header();
+				create.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			}
+			std::filesystem::resize_file(path, static_cast<std::uintmax_t>(bytes));
+			open_file(path);
+		}
+
+		// Opens an existing file.
+		explicit tiled_matrix(const std::string& path, Index cache_tiles) : capacity{ cache_tiles }
+		{
+			check_capacity();
+			open_file(path);
+
+			header h;
+			file.read(reinterpret_cast<char*>(&h), sizeof(h));
+			if (!file || std::memcmp(h.magic, file_magic, sizeof(h.magic)) != 0)
+				throw std::runtime_error{ "not a tiled matrix file: " + path };
+			if (h.elem_size != sizeof(T))
+				throw std::runtime_error{ "element size of tiled matrix file does not match" };
+			if (h.rows < 0 || h.cols < 0 || h.tile_rows <= 0 || h.tile_cols <= 0)
+				throw std::runtime_error{ "corrupt header in tiled matrix file: " + path };
+			if (std::max({ h.rows, h.cols, h.tile_rows, h.tile_cols }) > std::numeric_limits<Index>::max())
+				throw std::length_error{ "tiled matrix file is too large for Index" };
+
+			rows = static_cast<Index>(h.rows);
+			cols = static_cast<Index>(h.cols);
+			tile_r = static_cast<Index>(h.tile_rows);
+			tile_c = static_cast<Index>(h.tile_cols);
+
+			if (std::filesystem::file_size(path) != static_cast<std::uintmax_t>(file_bytes()))
+				throw std::runtime_error{ "size of tiled matrix file does not match its header: " + path };
+		}
+
+		tiled_matrix(const tiled_matrix&) = delete;
+		tiled_matrix& operator=(const tiled_matrix&) = delete;
+
+		~tiled_matrix()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				stopping = true;
+			}
+			cv.notify_all();
+			if (prefetcher.joinable())
+				prefetcher.join();
+
+			try { flush(); }
+			catch (...) {}
+		}
+
+		Index count_rows() const { return rows; }
+		Index count_cols() const { return cols; }
+		Index tile_rows() const { return tile_r; }
+		Index tile_cols() const { return tile_c; }
+		Index count_tile_rows() const { return rows / tile_r + (rows % tile_r != 0); }
+		Index count_tile_cols() const { return cols / tile_c + (cols % tile_c != 0); }
+
+		// Number of tiles read ahead after sequential pins (0 disables read-ahead).
+		void set_prefetch_depth(Index depth)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			prefetch_depth = std::max<Index>(0, std::min<Index>(depth, capacity / 2));
+		}
+
+		// Pins tile (tr, tc); 'write' marks it dirty so it is written back.
+		tile pin(Index tr, Index tc, bool write = false)
+		{
+			tile_check(tr, tc);
+			const std::int64_t key = tile_key(tr, tc);
+
+			std::unique_lock<std::mutex> lock(mtx);
+			entry* e = load(key, lock);
+			++e->pins;
+			e->dirty = e->dirty || write;
+			detect_sequential(key);
+			return tile(this, e);
+		}
+
+		// Asks the background thread to load tile (tr, tc).
+		void prefetch(Index tr, Index tc)
+		{
+			tile_check(tr, tc);
+			enqueue(tile_key(tr, tc));
+		}
+
+		T get(Index x, Index y)
+		{
+			range_check(x, y);
+			auto t = pin(x / tile_r, y / tile_c);
+			return t.row(x % tile_r)[y % tile_c];
+		}
+		void set(Index x, Index y, const T& val)
+		{
+			range_check(x, y);
+			auto t = pin(x / tile_r, y / tile_c, true);
+			t.row(x % tile_r)[y % tile_c] = val;
+		}
+
+		// Writes every dirty tile back to the file.
+		void flush()
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			for (auto& kv : cache)
+				write_back(kv.first, kv.second);
+			file.flush();
+		}
+
+	private:
+		static constexpr char file_magic[8] = { 'M', 'Y', 'T', 'I', 'L', 'E', 'S', '1' };
+
+		struct header
+		{
+			char magic[8];
+			std::int64_t rows;
+			std::int64_t cols;
+			std::int64_t tile_rows;
+			std::int64_t tile_cols;
+			std::int64_t elem_size;
+		};
+
+		struct entry
+		{
+			std::vector<T> buf;
+			bool dirty{ false };
+			int pins{ 0 };
+			typename std::list<std::int64_t>::iterator lru;
+		};
+
+		header make_header() const
+		{
+			header h{};
+			std::memcpy(h.magic, file_magic, sizeof(h.magic));
+			h.rows = rows;
+			h.cols = cols;
+			h.tile_rows = tile_r;
+			h.tile_cols = tile_c;
+			h.elem_size = sizeof(T);
+			return h;
+		}
+
+		void check_capacity() const
+		{
+			// the tile algorithms below pin up to three tiles at once
+			if (capacity < 3)
+				throw std::invalid_argument{ "tiled_matrix cache must hold at least 3 tiles" };
+		}
+
+		void open_file(const std::string& path)
+		{
+			file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+			prefetch_file.open(path, std::ios::binary);
+			if (!file || !prefetch_file)
+				throw std::runtime_error{ "unable to open tiled matrix file: " + path };
+		}
+
+		std::int64_t count_tiles() const { return std::int64_t(count_tile_rows()) * count_tile_cols(); }
+
+		// Size of the file for the current sizes; throws std::length_error if it does not fit
+		// in std::int64_t.
+		std::int64_t file_bytes() const
+		{
+			constexpr std::int64_t limit = std::numeric_limits<std::int64_t>::max();
+			const std::int64_t elem = sizeof(T);
+			const std::int64_t tile_rows_count = count_tile_rows();
+			const std::int64_t tile_cols_count = count_tile_cols();
+			if (tile_r > limit / elem / tile_c)
+				throw std::length_error{ "tiled matrix tile is too large" };
+			const std::int64_t tile_bytes = std::int64_t(tile_r) * tile_c * elem;
+			if (tile_cols_count != 0 && tile_rows_count > (limit - std::int64_t(sizeof(header))) / tile_bytes / tile_cols_count)
+				throw std::length_error{ "tiled matrix file is too large" };
+			return tile_offset(count_tiles());
+		}
+		std::int64_t tile_key(Index tr, Index tc) const { return std::int64_t(tr) * count_tile_cols() + tc; }
+		std::size_t tile_elems() const { return static_cast<std::size_t>(tile_r) * static_cast<std::size_t>(tile_c); }
+		std::int64_t tile_offset(std::int64_t key) const
+		{
+			return static_cast<std::int64_t>(sizeof(header)) + key * static_cast<std::int64_t>(tile_elems() * sizeof(T));
+		}
+
+		void tile_check(Index tr, Index tc) const
+		{
+			if (tr < 0 || tr >= count_tile_rows() || tc < 0 || tc >= count_tile_cols())
+				throw std::out_of_range{ "tile index is out of range of tiled_matrix" };
+		}
+		void range_check(Index x, Index y) const
+		{
+			if (x < 0 || x >= rows || y < 0 || y >= cols)
+				throw std::out_of_range{ "index is out of range of tiled_matrix" };
+		}
+
+		// The user thread does its I/O on 'file' with 'mtx' held; the prefetcher reads from its
+		// own 'prefetch_file' without the lock, so a pin never waits for a read-ahead.
+		void read_tile(std::istream& in, std::int64_t key, T* dst) const
+		{
+			in.clear();
+			in.seekg(tile_offset(key));
+			in.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(tile_elems() * sizeof(T)));
+			if (!in)
+				throw std::runtime_error{ "unable to read tile of tiled matrix file" };
+		}
+		void write_back(std::int64_t key, entry& e)
+		{
+			if (!e.dirty) return;
+			file.clear();
+			file.seekp(tile_offset(key));
+			file.write(reinterpret_cast<const char*>(e.buf.data()), static_cast<std::streamsize>(tile_elems() * sizeof(T)));
+			// flushed at once so that the prefetcher's own stream sees the tile
+			file.flush();
+			if (!file)
+				throw std::runtime_error{ "unable to write tile of tiled matrix file" };
+			e.dirty = false;
+			++writes;
+		}
+
+		// Evicts the least recently used unpinned tile when the cache is full.
+		bool make_room(bool required)
+		{
+			if (static_cast<Index>(cache.size()) < capacity) return true;
+
+			for (auto it = lru.rbegin(); it != lru.rend(); ++it)
+			{
+				auto found = cache.find(*it);
+				if (found->second.pins > 0) continue;
+
+				write_back(found->first, found->second);
+				lru.erase(std::next(it).base());
+				cache.erase(found);
+				return true;
+			}
+			if (required)
+				throw std::runtime_error{ "all tiles in the tiled_matrix cache are pinned" };
+			return false;
+		}
+
+		entry* insert(std::int64_t key, std::vector<T>&& buf)
+		{
+			auto& e = cache[key];
+			e.buf = std::move(buf);
+			lru.push_front(key);
+			e.lru = lru.begin();
+			return &e;
+		}
+
+		entry* load(std::int64_t key, std::unique_lock<std::mutex>&)
+		{
+			auto found = cache.find(key);
+			if (found != cache.end())
+			{
+				lru.splice(lru.begin(), lru, found->second.lru);
+				return &found->second;
+			}
+
+			make_room(true);
+			std::vector<T> buf(tile_elems());
+			read_tile(file, key, buf.data());
+			return insert(key, std::move(buf));
+		}
+
+		void unpin(entry* e)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			--e->pins;
+		}
+
+		void detect_sequential(std::int64_t key)
+		{
+			if (prefetch_depth > 0)
+			{
+				const std::int64_t stride = key - last_key;
+				if (stride == 1 || stride == count_tile_cols())
+				{
+					for (Index d = 1; d <= prefetch_depth; ++d)
+					{
+						const std::int64_t next = key + d * stride;
+						if (next >= count_tiles()) break;
+						if (cache.find(next) == cache.end())
+							queue.push_back(next);
+					}
+					start_prefetcher();
+					cv.notify_all();
+				}
+			}
+			last_key = key;
+		}
+
+		void enqueue(std::int64_t key)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				queue.push_back(key);
+				start_prefetcher();
+			}
+			cv.notify_all();
+		}
+
+		void start_prefetcher()
+		{
+			if (!prefetcher.joinable())
+				prefetcher = std::thread(&tiled_matrix::run_prefetch, this);
+		}
+
+		void run_prefetch()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			for (;;)
+			{
+				cv.wait(lock, [this] { return !queue.empty() || stopping; });
+				if (stopping) return;
+
+				const std::int64_t key = queue.front();
+				queue.pop_front();
+				if (cache.find(key) != cache.end()) continue;
+
+				const std::uint64_t writes_before = writes;
+				std::vector<T> buf;
+				try {
+					lock.unlock();
+					buf.resize(tile_elems());
+					read_tile(prefetch_file, key, buf.data());
+					lock.lock();
+				}
+				catch (...) {
+					// the user thread reports the error when it loads the tile itself
+					if (!lock.owns_lock()) lock.lock();
+					continue;
+				}
+				if (stopping) return;
+
+				// The user thread may have loaded the tile meanwhile, or written a tile back
+				// while it was being read (then the copy may be stale and is dropped).
+				// Read-ahead never evicts pinned tiles and gives up when it cannot make room.
+				if (cache.find(key) != cache.end() || writes != writes_before) continue;
+				try {
+					if (make_room(false))
+						insert(key, std::move(buf));
+				}
+				catch (...) {
+				}
+			}
+		}
+
+		Index rows{};
+		Index cols{};
+		Index tile_r{};
+		Index tile_c{};
+		Index capacity{};
+		Index prefetch_depth{ 2 };
+		std::int64_t last_key{ -1 };
+
+		std::fstream file;
+		std::ifstream prefetch_file;
+		std::uint64_t writes{ 0 };
+		std::unordered_map<std::int64_t, entry> cache;
+		std::list<std::int64_t> lru;
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::deque<std::int64_t> queue;
+		bool stopping{ false };
+		std::thread prefetcher;
+	};
+
+	// C = A * B tile by tile: for every tile of C the matching row of A tiles and column of
+	// B tiles are pinned one pair at a time and multiplied with the blocked kernel, so at
+	// most three tiles are needed in memory. Requires a.tile_cols() == b.tile_rows() and C
+	// tiles of a.tile_rows() x b.tile_cols().
+	template<class T>
+	void multiply(tiled_matrix<T>& a, tiled_matrix<T>& b, tiled_matrix<T>& c)
+	{
+		if (a.count_cols() != b.count_rows())
+			throw std::invalid_argument{ "cols count of left matrix is not equal to rows count of right matrix" };
+		if (c.count_rows() != a.count_rows() || c.count_cols() != b.count_cols())
+			throw std::invalid_argument{ "result matrix has wrong size" };
+		if (a.tile_cols() != b.tile_rows() || c.tile_rows() != a.tile_rows() || c.tile_cols() != b.tile_cols())
+			throw std::invalid_argument{ "tile sizes of tiled matrices do not match" };
+
+		const Index tm = a.tile_rows();
+		const Index tk = a.tile_cols();
+		const Index tn = b.tile_cols();
+
+		for (Index i = 0; i < c.count_tile_rows(); ++i)
+		{
+			for (Index j = 0; j < c.count_tile_cols(); ++j)
+			{
+				auto ct = c.pin(i, j, true);
+				std::fill(ct.data(), ct.data() + static_cast<std::size_t>(tm) * tn, T{});
+				for (Index p = 0; p < a.count_tile_cols(); ++p)
+				{
+					auto at = a.pin(i, p);
+					auto bt = b.pin(p, j);
+					gemm_accumulate<T>(tm, tn, tk,
+						strided_rows<const T>{ at.data(), tk },
+						strided_rows<const T>{ bt.data(), tn },
+						strided_rows<T>{ ct.data(), tn });
+				}
+			}
+		}
+	}
+
+	// out = transpose(a); out must be cols x rows with tiles of a.tile_cols() x a.tile_rows().
+	template<class T>
+	void transpose(tiled_matrix<T>& a, tiled_matrix<T>& out)
+	{
+		if (out.count_rows() != a.count_cols() || out.count_cols() != a.count_rows())
+			throw std::invalid_argument{ "result matrix has wrong size" };
+		if (out.tile_rows() != a.tile_cols() || out.tile_cols() != a.tile_rows())
+			throw std::invalid_argument{ "tile sizes of tiled matrices do not match" };
+
+		for (Index i = 0; i < a.count_tile_rows(); ++i)
+		{
+			for (Index j = 0; j < a.count_tile_cols(); ++j)
+			{
+				auto src = a.pin(i, j);
+				auto dst = out.pin(j, i, true);
+				for (Index r = 0; r < a.tile_rows(); ++r)
+				{
+					const T* s = src.row(r);
+					for (Index c = 0; c < a.tile_cols(); ++c)
+						dst.row(c)[r] = s[c];
+				}
+			}
+		}
+	}
+
+	// Reductions streaming the tiles in row-major tile order (which triggers read-ahead).
+	// Every tile row is summed with 's'; the partial sums go into one running (compensated
+	// unless naive) accumulator, so memory does not grow with the matrix.
+	template<class T>
+	T sum(tiled_matrix<T>& mtx, summation s = summation::naive)
+	{
+		T result{};
+		T comp{};
+		for (Index i = 0; i < mtx.count_tile_rows(); ++i)
+		{
+			const Index rows = std::min(mtx.tile_rows(), mtx.count_rows() - i * mtx.tile_rows());
+			for (Index j = 0; j < mtx.count_tile_cols(); ++j)
+			{
+				const Index cols = std::min(mtx.tile_cols(), mtx.count_cols() - j * mtx.tile_cols());
+				auto t = mtx.pin(i, j);
+				for (Index r = 0; r < rows; ++r)
+				{
+					const T part = detail::sum_span(t.row(r), cols, s, detail::identity_op{});
+					if (s == summation::naive)
+						result += part;
+					else
+						detail::kahan_add(result, comp, part);
+				}
+			}
+		}
+		return result;
+	}
+
+	template<class T>
+	std::vector<T> row_sums(tiled_matrix<T>& mtx, summation s = summation::naive)
+	{
+		std::vector<T> result(mtx.count_rows());
+		std::vector<T> comp(mtx.count_rows());
+		for (Index i = 0; i < mtx.count_tile_rows(); ++i)
+		{
+			const Index rows = std::min(mtx.tile_rows(), mtx.count_rows() - i * mtx.tile_rows());
+			for (Index j = 0; j < mtx.count_tile_cols(); ++j)
+			{
+				const Index cols = std::min(mtx.tile_cols(), mtx.count_cols() - j * mtx.tile_cols());
+				auto t = mtx.pin(i, j);
+				for (Index r = 0; r < rows; ++r)
+				{
+					const T part = detail::sum_span(t.row(r), cols, s, detail::identity_op{});
+					const Index x = i * mtx.tile_rows() + r;
+					if (s == summation::naive)
+						result[x] += part;
+					else
+						detail::kahan_add(result[x], comp[x], part);
+				}
+			}
+		}
+		return result;
+	}
+
+	template<class T>
+	std::vector<T> col_sums(tiled_matrix<T>& mtx, summation s = summation::naive)
+	{
+		std::vector<T> result(mtx.count_cols());
+		std::vector<T> comp(mtx.count_cols());
+		for (Index i = 0; i < mtx.count_tile_rows(); ++i)
+		{
+			const Index rows = std::min(mtx.tile_rows(), mtx.count_rows() - i * mtx.tile_rows());
+			for (Index j = 0; j < mtx.count_tile_cols(); ++j)
+			{
+				const Index cols = std::min(mtx.tile_cols(), mtx.count_cols() - j * mtx.tile_cols());
+				auto t = mtx.pin(i, j);
+				T* out = result.data() + j * mtx.tile_cols();
+				T* c = comp.data() + j * mtx.tile_cols();
+				for (Index r = 0; r < rows; ++r)
+				{
+					const T* row = t.row(r);
+					for (Index y = 0; y < cols; ++y)
+					{
+						if (s == summation::naive)
+							out[y] += row[y];
+						else
+							detail::kahan_add(out[y], c[y], row[y]);
+					}
+				}
+			}
+		}
+		return result;
+	}
+}
+
+#endif // TILED_MATRIX_HPP
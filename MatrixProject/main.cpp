@@ -19,7 +19,7 @@ int main(int argc, char** argv)
 		my::matrix<int> mtx(3, 3);
 
 		int counter{ 0 };
-		for (auto& row : mtx)
+		for (auto&& row : mtx)
 		{
 			for (auto& i : row)
 			{